@@ -31,6 +31,9 @@ bool estop_relay_on = false;
 // Protects camera_relay_on and estop_relay_on
 std::mutex relay_mutex;
 
+// Relay status is published when it changes, and at this interval
+static constexpr int STATUS_KEEPALIVE_INTERVAL_S = 30*60;
+
 static bool check_console(Display& display)
 {
     display.add_progress("Wait for console");
@@ -136,7 +139,8 @@ void app_main()
     display.set_status(camera_relay_on, estop_relay_on);
     bool last_button = false;
     int debounce = 0;
-    int mqtt_count = 0;
+    publish_mqtt_status(camera_relay_on, estop_relay_on);
+    time_t last_status_time = start_time;
     while (1)
     {
         vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -158,10 +162,20 @@ void app_main()
                 }
             }
         }
+        time_t current_time;
+        time(&current_time);
         if (camera_relay_on != last_camera_relay_on ||
             estop_relay_on != last_estop_relay_on)
         {
             display.set_status(camera_relay_on, estop_relay_on);
+            publish_mqtt_status(camera_relay_on, estop_relay_on);
+            last_status_time = current_time;
+        }
+        else if (current_time - last_status_time >= STATUS_KEEPALIVE_INTERVAL_S)
+        {
+            // Liveness is tracked by the MQTT Last Will, this is just a refresh
+            publish_mqtt_status(camera_relay_on, estop_relay_on);
+            last_status_time = current_time;
         }
 
         set_relay1(camera_relay_on);
@@ -170,15 +184,6 @@ void app_main()
         last_camera_relay_on = camera_relay_on;
         last_estop_relay_on = estop_relay_on;
 
-        ++mqtt_count;
-        if (mqtt_count >= 10000)
-        {
-            publish_mqtt_status(camera_relay_on, estop_relay_on);
-            mqtt_count = 0;
-        }
-        
-        time_t current_time;
-        time(&current_time);
         const auto since_start = current_time - start_time;
         if (since_start > 15*60)
         {
@@ -8,6 +8,12 @@
 
 #include "defs.h"
 
+// The broker publishes our Last Will when it has not heard from us for 1.5
+// times this interval
+static constexpr int KEEPALIVE_S = 20;
+
+static constexpr const char* ONLINE_TOPIC = "hal9k/camctl/online";
+
 static bool connected = false;
 static esp_mqtt_client_handle_t client = 0;
 
@@ -23,6 +29,8 @@ static void mqtt_event_handler(void* handler_args,
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
         connected = true;
+        // Birth message, replacing the retained Last Will
+        esp_mqtt_client_enqueue(client, ONLINE_TOPIC, "online", 0, 1, 1, true);
         break;
 
     case MQTT_EVENT_DISCONNECTED:
@@ -74,6 +82,11 @@ void start_mqtt(const std::string& mqtt_address)
     };
     ESP_LOGI(TAG, "MQTT URL %s", mqtt_url.c_str());
     mqtt_cfg.broker.address.uri = mqtt_url.c_str();
+    mqtt_cfg.session.keepalive = KEEPALIVE_S;
+    mqtt_cfg.session.last_will.topic = ONLINE_TOPIC;
+    mqtt_cfg.session.last_will.msg = "offline";
+    mqtt_cfg.session.last_will.qos = 1;
+    mqtt_cfg.session.last_will.retain = true;
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client,
                                    static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID),
@@ -2,6 +2,8 @@
 
 #include <string>
 
+/// Connect to MQTT. hal9k/camctl/online is set to "online" (retained) on
+/// connect, and the broker sets it to "offline" when we disappear.
 void start_mqtt(const std::string& mqtt_address);
 
 void log_mqtt(const std::string& msg);
@@ -0,0 +1,153 @@
+#include "cardcache.h"
+#include "mqtt.h"
+#include "nvs.h"
+
+#include "esp_http_client.h"
+#include "esp_partition.h"
+#include "mqtt_client.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/// Calls the private Card_cache::find()
+struct Card_cache_bench
+{
+    static bool find(Card_table::Card_id id)
+    {
+        Card_table::User_info ui;
+        return Card_cache::instance().find(id, ui);
+    }
+};
+
+/// /v2/permissions response. user_base makes the two tables differ.
+static std::string make_permissions(const std::vector<Card_table::Card_id>& ids, int user_base)
+{
+    std::string json = "[";
+    char item[200];
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        snprintf(item, sizeof(item), "%s{\"card_id\": \"%010llX\", \"id\": %d, \"int_id\": %d, \"name\": \"Member\"}",
+                 i ? ", " : "", static_cast<unsigned long long>(ids[i]),
+                 user_base + static_cast<int>(i), static_cast<int>(i));
+        json += item;
+    }
+    return json + "]";
+}
+
+struct Latencies
+{
+    std::vector<int64_t> ns;
+
+    void report(const char* name)
+    {
+        std::sort(ns.begin(), ns.end());
+        auto at = [this](double p)
+        {
+            return ns[std::min(ns.size() - 1, static_cast<size_t>(p*ns.size()))];
+        };
+        printf("%-22s median %5lld ns, 99.9%% %7lld ns, max %8lld ns\n", name,
+               static_cast<long long>(at(0.5)), static_cast<long long>(at(0.999)),
+               static_cast<long long>(ns.back()));
+    }
+};
+
+int main()
+{
+    uint8_t key[SIGNING_KEY_SIZE] = { 1, 2, 3 };
+    set_identifier("main");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    set_private_key(key);
+    init_nvs();
+    fake_partition::reset("cards", 128*1024);
+    fake_partition::reset("spill", 64*1024);
+    Mqtt::instance().start(get_mqtt_address());
+    fake_mqtt::connect();
+
+    const int NOF_CARDS = 2000;
+    std::mt19937_64 rng(1);
+    std::vector<Card_table::Card_id> ids(NOF_CARDS);
+    for (auto& id : ids)
+        id = rng() & 0xFFFFFFFFFF;
+    const std::string tables[2] = { make_permissions(ids, 1000), make_permissions(ids, 5000) };
+    fake_http::set_response(200, tables[0], "\"0\"");
+
+    // The refresh task, as started by main.cpp
+    auto& cache = Card_cache::instance();
+    cache.set_api_token(get_acs_token());
+    std::atomic<TaskHandle_t> refresh_task = nullptr;
+    std::thread refresher([&refresh_task]()
+    {
+        refresh_task = xTaskGetCurrentTaskHandle();
+        card_cache_task(nullptr);
+    });
+    // It never returns
+    refresher.detach();
+    while (cache.has_access(ids[0]).access != Card_cache::Access::Allowed)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // Lookups by the controller, with and without a refresh running at the
+    // same time. Each refresh fetches and parses a changed table, saves it
+    // in flash, and publishes the new snapshot.
+    const int BATCH = 10000;
+    const int NOF_BATCHES = 200;
+    for (bool refreshing : { false, true })
+    {
+        // The snapshot load and lookup alone, and with logging the entry
+        Latencies find_latencies, access_latencies;
+        int nof_refreshes = fake_http::get_nof_requests();
+        for (int batch = 0; batch < NOF_BATCHES; ++batch)
+        {
+            if (refreshing)
+            {
+                // Change the table, and wake up the refresh task
+                char etag[16];
+                snprintf(etag, sizeof(etag), "\"%d\"", batch);
+                fake_http::set_response(200, tables[batch % 2], etag);
+                xTaskNotifyGive(refresh_task);
+            }
+            for (int i = 0; i < BATCH; ++i)
+            {
+                const auto id = ids[rng() % NOF_CARDS];
+                const auto start = std::chrono::steady_clock::now();
+                const bool found = Card_cache_bench::find(id);
+                const auto middle = std::chrono::steady_clock::now();
+                const auto result = cache.has_access(id);
+                const auto end = std::chrono::steady_clock::now();
+                if (!found || result.access != Card_cache::Access::Allowed)
+                {
+                    printf("Card not found\n");
+                    _exit(1);
+                }
+                find_latencies.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count());
+                access_latencies.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count());
+            }
+            // Granted entries are logged to the backend
+            fake_mqtt::take_published();
+        }
+        nof_refreshes = fake_http::get_nof_requests() - nof_refreshes;
+        find_latencies.report(refreshing ? "find, refreshing" : "find");
+        access_latencies.report(refreshing ? "has_access, refreshing" : "has_access");
+        if (refreshing)
+            printf("%d refreshes of %d cards during %d lookups\n",
+                   nof_refreshes, NOF_CARDS, BATCH*NOF_BATCHES);
+    }
+    printf("find() is the snapshot load and binary search. has_access() also signs\n"
+           "and queues the backend log message.\n"
+           "The tail is the host's scheduler preempting the lookup.\n");
+    fflush(stdout);
+    // Do not run destructors under the refresh task's feet
+    _exit(0);
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_cardcache"
+// End:
@@ -0,0 +1,117 @@
+#include "cardcache.h"
+#include "mqtt.h"
+#include "nvs.h"
+
+#include <cardformat.h>
+
+#include "esp_http_client.h"
+#include "esp_partition.h"
+#include "mqtt_client.h"
+
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <time.h>
+
+/// Calls the private Card_cache::update()
+struct Card_cache_bench
+{
+    static bool update()
+    {
+        return Card_cache::instance().update();
+    }
+};
+
+// Size of the 'cards' partition in partitions.csv
+static constexpr size_t CARDS_PARTITION_SIZE = 128*1024;
+
+// REFRESH_INTERVAL_MS in cardcache.cpp
+static constexpr int REFRESHES_PER_HOUR = 60;
+
+/// /v2/permissions response
+static std::string make_permissions(int nof_cards)
+{
+    std::mt19937_64 rng(1);
+    std::string json = "[";
+    char item[200];
+    for (int i = 0; i < nof_cards; ++i)
+    {
+        snprintf(item, sizeof(item), "%s{\"card_id\": \"%010llX\", \"id\": %d, \"int_id\": %d, \"name\": \"Member\"}",
+                 i ? ", " : "", static_cast<unsigned long long>(rng() & 0xFFFFFFFFFF), 1000 + i, i);
+        json += item;
+    }
+    return json + "]";
+}
+
+static double thread_cpu_us()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+struct Cost
+{
+    double bytes;
+    double cpu_us;
+};
+
+/// Average cost of n calls of update(). If changed, each request gets a
+/// new ETag, so the whole table is sent; otherwise the reply is a 304.
+static Cost measure(const std::string& table, int n, bool changed)
+{
+    const auto bytes = fake_http::get_nof_bytes();
+    double cpu_us = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        if (changed)
+            fake_http::set_response(200, table, std::to_string(i));
+        const auto start = thread_cpu_us();
+        const bool ok = Card_cache_bench::update();
+        cpu_us += thread_cpu_us() - start;
+        if (!ok)
+        {
+            printf("Update failed\n");
+            exit(1);
+        }
+        fake_mqtt::take_published();
+    }
+    return Cost{ static_cast<double>(fake_http::get_nof_bytes() - bytes)/n, cpu_us/n };
+}
+
+int main()
+{
+    uint8_t key[SIGNING_KEY_SIZE] = { 1, 2, 3 };
+    set_identifier("main");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    set_private_key(key);
+    init_nvs();
+    fake_partition::reset("cards", CARDS_PARTITION_SIZE);
+    fake_partition::reset("spill", 64*1024);
+    Mqtt::instance().start(get_mqtt_address());
+    fake_mqtt::connect();
+    Card_cache::instance().set_api_token(get_acs_token());
+
+    // As many cards as the stored table can hold
+    const int nof_cards = card_format::max_entries(CARDS_PARTITION_SIZE/2);
+    const auto table = make_permissions(nof_cards);
+    const auto changed = measure(table, 20, true);
+    // The last ETag is still current
+    const auto unchanged = measure(table, 1000, false);
+
+    printf("%d cards, %zu byte response\n", nof_cards, table.size());
+    printf("%-10s %12s %12s %14s %14s\n", "", "bytes", "CPU", "bytes/hour", "CPU/hour");
+    for (const auto& [name, cost] : { std::pair("200", changed), std::pair("304", unchanged) })
+        printf("%-10s %12.0f %9.3f ms %14.0f %11.1f ms\n", name, cost.bytes, cost.cpu_us/1000,
+               cost.bytes*REFRESHES_PER_HOUR, cost.cpu_us*REFRESHES_PER_HOUR/1000);
+    printf("Polling every %d s. Bytes are the response body, without headers and TLS.\n"
+           "CPU is the host's, and a 200 also rewrites the stored table in flash.\n",
+           3600/REFRESHES_PER_HOUR);
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_cardcache_refresh"
+// End:
@@ -0,0 +1,104 @@
+#include <cardtable.h>
+
+#include <chrono>
+#include <malloc.h>
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/// Heap in use, including allocator overhead (8 to 16 bytes per block
+/// here, 8 on the ESP32)
+static size_t heap_in_use()
+{
+    const auto info = mallinfo2();
+    // Large blocks are mmap()ed
+    return info.uordblks + info.hblkhd;
+}
+
+/// What Card_cache used before Card_table
+struct Old_user_info
+{
+    int user_id = 0;
+    int user_int_id = 0;
+    Card_table::time_point last_update;
+};
+
+using Old_cache = std::map<Card_table::Card_id, Old_user_info>;
+
+// Keep the optimizer from removing lookups
+static volatile int sink;
+
+template<typename Lookup>
+static double ns_per_lookup(const std::vector<Card_table::Card_id>& ids, Lookup lookup)
+{
+    const int ROUNDS = 10;
+    const auto start = std::chrono::steady_clock::now();
+    int found = 0;
+    for (int round = 0; round < ROUNDS; ++round)
+        for (auto id : ids)
+            found += lookup(id);
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    sink = found;
+    return elapsed.count()/(ROUNDS*ids.size());
+}
+
+int main()
+{
+    printf("%7s | %-20s | %-20s | %s\n", "", "Card_table", "std::map", "lookup ns (hit/miss)");
+    printf("%7s | %8s %11s | %8s %11s | %9s %9s\n",
+           "cards", "bytes", "bytes/card", "bytes", "bytes/card", "table", "map");
+    for (int nof_cards : { 1000, 10000, 100000 })
+    {
+        std::mt19937_64 rng(nof_cards);
+        std::vector<Card_table::Card_id> ids(nof_cards), misses(nof_cards);
+        for (auto& id : ids)
+            id = rng() & 0xFFFFFFFFFF;
+        for (auto& id : misses)
+            id = rng() & 0xFFFFFFFFFF;
+        std::vector<Card_table::Card_id> lookups = ids;
+        std::shuffle(lookups.begin(), lookups.end(), rng);
+
+        auto before = heap_in_use();
+        auto table = new Card_table;
+        table->reserve(nof_cards);
+        for (int i = 0; i < nof_cards; ++i)
+            table->add(ids[i], i, i + 1);
+        table->finalize();
+        const auto table_bytes = heap_in_use() - before;
+
+        before = heap_in_use();
+        auto map = new Old_cache;
+        const auto now = std::chrono::system_clock::now();
+        for (int i = 0; i < nof_cards; ++i)
+            (*map)[ids[i]] = Old_user_info{ i, i + 1, now };
+        const auto map_bytes = heap_in_use() - before;
+
+        auto table_lookup = [table](Card_table::Card_id id)
+        {
+            Card_table::User_info info;
+            return table->find(id, info) ? info.user_int_id : 0;
+        };
+        auto map_lookup = [map](Card_table::Card_id id)
+        {
+            const auto it = map->find(id);
+            return it != map->end() ? it->second.user_int_id : 0;
+        };
+        printf("%7d | %8zu %11.1f | %8zu %11.1f | %4.0f/%-4.0f %4.0f/%-4.0f\n",
+               nof_cards,
+               table_bytes, double(table_bytes)/nof_cards,
+               map_bytes, double(map_bytes)/nof_cards,
+               ns_per_lookup(lookups, table_lookup), ns_per_lookup(misses, table_lookup),
+               ns_per_lookup(lookups, map_lookup), ns_per_lookup(misses, map_lookup));
+        delete table;
+        delete map;
+    }
+    printf("Map bytes are for this host (%zu-bit pointers). On the ESP32 a node is\n"
+           "40 bytes plus 8 bytes of allocator overhead.\n", 8*sizeof(void*));
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_cardtable"
+// End:
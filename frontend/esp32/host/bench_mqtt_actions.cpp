@@ -0,0 +1,163 @@
+#include "mqtt.h"
+#include "nvs.h"
+#include "signer.h"
+
+#include "esp_partition.h"
+#include "mqtt_client.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t ACTION_BITS = 1;
+static constexpr uint32_t STATUS_BITS = 2;
+
+/// Signed action message, as sent by mqtt-loadgen
+static std::string make_action(size_t stamp, const char* action)
+{
+    const char* text = "loadtest";
+    char hash[Signer::HEX_SIZE];
+    // check_signature() hashes the stamp as a size_t
+    Signer::instance().sign(&stamp, sizeof(stamp), text, strlen(text), hash);
+    char buf[300];
+    snprintf(buf, sizeof(buf), "{\"stamp\": %zu, \"text\": \"%s\", \"hash\": \"%s\", \"action\": \"%s\"}",
+             stamp, text, hash, action);
+    return buf;
+}
+
+static std::string make_status(int i)
+{
+    char buf[300];
+    snprintf(buf, sizeof(buf),
+             "{\"timestamp\":\"2026-10-17T12:00:00\",\"data\":{\"door\":\"%s\",\"space\":\"closed\","
+             "\"lock_status\":\"locked\",\"version\":\"1.2.3\"}}",
+             i % 7 ? "closed" : "open");
+    return buf;
+}
+
+static double percentile(std::vector<int64_t>& v, double p)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(p*v.size()))];
+}
+
+int main()
+{
+    uint8_t key[SIGNING_KEY_SIZE] = { 1, 2, 3 };
+    set_identifier("main");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    set_private_key(key);
+    init_nvs();
+    fake_partition::reset("spill", 64*1024);
+    auto& mqtt = Mqtt::instance();
+    mqtt.start(get_mqtt_address());
+    fake_mqtt::connect();
+    const std::string topic = "hal9k/acs/action/main";
+
+    // Parse cost: cJSON parse, signature check and queueing of one action
+    const int N = 50000;
+    std::vector<std::string> actions;
+    for (int i = 0; i < N; ++i)
+        actions.push_back(make_action(1000000 + i, "ping"));
+    Mqtt::Action action;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& data : actions)
+    {
+        fake_mqtt::deliver(topic, data);
+        mqtt.get_next_action(action);
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    printf("Action parse cost: %.2f us/action\n", elapsed.count()/N);
+    fake_mqtt::take_published();
+
+    // Throughput: status messages with an action after every
+    // ACTION_INTERVAL of them, delivered as fast as possible. Actions are
+    // taken from the queue right away.
+    const int ACTION_INTERVAL = 20;
+    std::vector<std::string> statuses;
+    for (int i = 0; i < 32; ++i)
+        statuses.push_back(make_status(i));
+    std::vector<std::string> status_topics;
+    for (int i = 0; i < ACTION_INTERVAL; ++i)
+        status_topics.push_back("hal9k/acs/status/door" + std::to_string(i));
+    int nof_messages = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i)
+    {
+        for (int j = 0; j < ACTION_INTERVAL; ++j)
+            fake_mqtt::deliver(status_topics[j], statuses[(i + j) % statuses.size()]);
+        fake_mqtt::deliver(topic, actions[i]);
+        mqtt.get_next_action(action);
+        nof_messages += ACTION_INTERVAL + 1;
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    printf("Throughput: %.0f messages/s (1 action per %d status messages)\n",
+           nof_messages/(elapsed.count()/1e6), ACTION_INTERVAL);
+    fake_mqtt::take_published();
+
+    // Queueing latency: a controller task handles actions, like
+    // Controller::run(), while the MQTT task delivers a busy fleet's
+    // traffic at a steady rate
+    const int STATUS_PER_S = 1000;
+    const int ACTIONS_PER_S = 50;
+    const int SECONDS = 2;
+    std::atomic<bool> done = false;
+    std::atomic<TaskHandle_t> controller_task = nullptr;
+    std::vector<int64_t> latencies_us;
+    std::thread controller([&]()
+    {
+        controller_task = xTaskGetCurrentTaskHandle();
+        mqtt.set_listener(controller_task, ACTION_BITS, STATUS_BITS);
+        while (!done)
+        {
+            uint32_t bits = 0;
+            xTaskNotifyWait(0, ~0u, &bits, portMAX_DELAY);
+            Mqtt::Action pending;
+            while (mqtt.get_next_action(pending))
+            {
+                latencies_us.push_back(esp_timer_get_time() - pending.received);
+                mqtt.ack_action(pending, "ok");
+            }
+            mqtt.process();
+        }
+    });
+    while (!controller_task)
+        std::this_thread::yield();
+    const int nof_actions = ACTIONS_PER_S*SECONDS;
+    const auto interval = std::chrono::microseconds(1000000/STATUS_PER_S);
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < STATUS_PER_S*SECONDS; ++i)
+    {
+        std::this_thread::sleep_until(next);
+        next += interval;
+        fake_mqtt::deliver(status_topics[i % ACTION_INTERVAL], statuses[i % statuses.size()]);
+        if (i % (STATUS_PER_S/ACTIONS_PER_S) == 0)
+            fake_mqtt::deliver(topic, actions[i/(STATUS_PER_S/ACTIONS_PER_S)]);
+    }
+    done = true;
+    xTaskNotify(controller_task, ACTION_BITS, eSetBits);
+    controller.join();
+
+    int nof_ok = 0;
+    for (const auto& msg : fake_mqtt::take_published())
+        if (msg.topic == "hal9k/acs/ack/main")
+            nof_ok += msg.data.find("\"result\":\"ok\"") != std::string::npos;
+    printf("Queueing latency at %d status messages and %d actions per second:\n"
+           "  %d of %d actions handled, median %.0f us, 99%% %.0f us, max %.0f us\n",
+           STATUS_PER_S, ACTIONS_PER_S, nof_ok, nof_actions,
+           percentile(latencies_us, 0.5), percentile(latencies_us, 0.99), percentile(latencies_us, 1.0));
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_mqtt_actions"
+// End:
@@ -0,0 +1,222 @@
+#include "format.h"
+#include "jsonwriter.h"
+#include "mqtt.h"
+#include "nvs.h"
+#include "signer.h"
+#include "util.h"
+
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "mqtt_client.h"
+
+#include <functional>
+#include <stdio.h>
+#include <string>
+
+// Count heap allocations made by this thread while building and
+// enqueueing a payload. Mqtt's own tasks allocate too.
+static thread_local size_t nof_allocs = 0;
+
+extern "C" void* __libc_malloc(size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+    ++nof_allocs;
+    return __libc_malloc(size);
+}
+
+// Intervals in controller.cpp. Before Json_writer, the status was
+// published every 15 s.
+static constexpr int OLD_STATUS_INTERVAL_S = 15;
+static constexpr int STATUS_KEEPALIVE_INTERVAL_S = 30*60;
+
+static const char* boot_timestamp = "2026-10-17T02:00:05+0000";
+static const char* version = "1.2.3";
+
+/// What Controller::set_mqtt_device_status() did before Json_writer
+static void old_status(esp_mqtt_client_handle_t client)
+{
+    char timestamp[util::TIMESTAMP_SIZE];
+    util::make_timestamp(timestamp, true);
+    auto payload = cJSON_CreateObject();
+    auto jtimestamp = cJSON_CreateString(timestamp);
+    cJSON_AddItemToObject(payload, "timestamp", jtimestamp);
+
+    auto status = cJSON_CreateObject();
+    auto door = cJSON_CreateString("closed");
+    cJSON_AddItemToObject(status, "door", door);
+    auto space = cJSON_CreateString("closed");
+    cJSON_AddItemToObject(status, "space", space);
+    auto lock = cJSON_CreateString("locked");
+    cJSON_AddItemToObject(status, "lock_status", lock);
+    auto boot_time_string = cJSON_CreateString(boot_timestamp);
+    cJSON_AddItemToObject(status, "boot_time", boot_time_string);
+    auto heartbeat = cJSON_CreateString(timestamp);
+    cJSON_AddItemToObject(status, "card_reader_heartbeat", heartbeat);
+    auto jversion = cJSON_CreateString(version);
+    cJSON_AddItemToObject(status, "version", jversion);
+    cJSON_AddItemToObject(payload, "data", status);
+    char* data = cJSON_PrintUnformatted(payload);
+    cJSON_Delete(payload);
+    // Old Mqtt::set_status()
+    const auto topic = format("hal9k/acs/status/%s", get_identifier().c_str());
+    esp_mqtt_client_enqueue(client, topic.c_str(), data, 0, 1, 1, true);
+    cJSON_free(data);
+}
+
+/// What Controller::set_mqtt_device_status() does now
+static void new_status()
+{
+    char timestamp[util::TIMESTAMP_SIZE];
+    util::make_timestamp(timestamp, true);
+    char buffer[400];
+    Json_writer payload(buffer, sizeof(buffer));
+    payload.begin_object();
+    payload.key("timestamp").string(timestamp);
+    payload.key("data").begin_object();
+    payload.key("door").string("closed");
+    payload.key("space").string("closed");
+    payload.key("lock_status").string("locked");
+    payload.key("boot_time").string(boot_timestamp);
+    payload.key("card_reader_heartbeat").string(timestamp);
+    payload.key("version").string(version);
+    payload.end_object();
+    payload.end_object();
+    Mqtt::instance().set_status(payload.c_str());
+}
+
+/// Old Mqtt::sign() and the code around it in log_backend() and
+/// write_slack()
+static void old_publish_signed(esp_mqtt_client_handle_t client, const char* topic,
+                               const std::string& message, int user_id)
+{
+    auto payload = cJSON_CreateObject();
+    if (user_id >= 0)
+        cJSON_AddItemToObject(payload, "user_id", cJSON_CreateNumber(user_id));
+    time_t now;
+    time(&now);
+    cJSON_AddItemToObject(payload, "stamp", cJSON_CreateNumber(now));
+    char hex_hash[Signer::HEX_SIZE];
+    Signer::instance().sign(&now, sizeof(now), message.c_str(), message.size(), hex_hash);
+    cJSON_AddItemToObject(payload, "hash", cJSON_CreateString(hex_hash));
+    cJSON_AddItemToObject(payload, "identifier", cJSON_CreateString(get_identifier().c_str()));
+    cJSON_AddItemToObject(payload, "text", cJSON_CreateString(message.c_str()));
+    char* data = cJSON_PrintUnformatted(payload);
+    cJSON_Delete(payload);
+    esp_mqtt_client_enqueue(client, topic, data, 0, 1, 0, true);
+    cJSON_free(data);
+}
+
+struct Result
+{
+    double allocs;
+    size_t bytes;
+};
+
+/// Allocations per call of fn, not counting those made by the fake
+/// client to record the message, and size of the last payload
+static Result measure(const std::function<void()>& fn)
+{
+    // The first call sets up the signer and the MQTT outbox
+    fn();
+    fake_mqtt::take_published();
+
+    const int N = 1000;
+    size_t allocs = 0;
+    fake_mqtt::Message last;
+    for (int i = 0; i < N; ++i)
+    {
+        const auto before = nof_allocs;
+        fn();
+        allocs += nof_allocs - before;
+        for (auto& m : fake_mqtt::take_published())
+        {
+            // Recording copies topic and data into the list of messages
+            const auto before = nof_allocs;
+            std::vector<fake_mqtt::Message> v;
+            v.push_back({ m.topic, m.data });
+            allocs -= nof_allocs - before;
+            last = std::move(m);
+        }
+    }
+    return Result{ static_cast<double>(allocs)/N, last.data.size() };
+}
+
+int main()
+{
+    // Mqtt logs each message it queues
+    fake_log_level = ESP_LOG_ERROR;
+    uint8_t key[SIGNING_KEY_SIZE] = { 1, 2, 3 };
+    set_identifier("main");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    set_private_key(key);
+    init_nvs();
+    fake_partition::reset("spill", 64*1024);
+    auto& mqtt = Mqtt::instance();
+    mqtt.start(get_mqtt_address());
+    fake_mqtt::connect();
+    fake_mqtt::take_published();
+    const auto client = esp_mqtt_client_init(nullptr);
+
+    // On the host, cloning the hash state allocates, unlike on the ESP32
+    const auto sign_allocs = measure([]
+    {
+        const time_t stamp = 0;
+        char hex[Signer::HEX_SIZE];
+        Signer::instance().sign(&stamp, sizeof(stamp), "x", 1, hex);
+    }).allocs;
+
+    const std::string granted = "main: Granted entry";
+    const std::string slack = ":key: Valid card swiped, unlocking";
+    const struct
+    {
+        const char* name;
+        int nof_signatures;
+        std::function<void()> old_way, new_way;
+    } cases[] = {
+        { "status", 0,
+          [&] { old_status(client); },
+          [&] { new_status(); } },
+        { "log_backend", 1,
+          [&] { old_publish_signed(client, "hal9k/acs/backend/log", granted, 42); },
+          [&] { mqtt.log_backend(42, granted); } },
+        { "write_slack", 1,
+          [&] { old_publish_signed(client, "hal9k/acs/backend/slack",
+                                   format("%s|%s", slack.c_str(), "private-monitoring"), -1); },
+          [&] { mqtt.write_slack(slack); } },
+    };
+    printf("Heap allocations per message, not counting signing\n");
+    printf("%-12s %8s %8s %8s\n", "", "cJSON", "writer", "bytes");
+    size_t status_bytes = 0;
+    for (const auto& c : cases)
+    {
+        const auto old_result = measure(c.old_way);
+        const auto new_result = measure(c.new_way);
+        printf("%-12s %8.1f %8.1f %8zu\n", c.name,
+               old_result.allocs - c.nof_signatures*sign_allocs,
+               new_result.allocs - c.nof_signatures*sign_allocs, new_result.bytes);
+        if (old_result.bytes != new_result.bytes)
+        {
+            printf("Payload sizes differ: %zu and %zu\n", old_result.bytes, new_result.bytes);
+            return 1;
+        }
+        if (!status_bytes)
+            status_bytes = new_result.bytes;
+    }
+
+    // Retained status traffic, not counting topics and MQTT overhead
+    printf("\nStatus bytes/hour, every %d s: %zu\n", OLD_STATUS_INTERVAL_S,
+           status_bytes*3600/OLD_STATUS_INTERVAL_S);
+    for (int changes : { 0, 10, 60 })
+        printf("Status bytes/hour, %2d changes + keepalive every %d min: %zu\n", changes,
+               STATUS_KEEPALIVE_INTERVAL_S/60,
+               status_bytes*(changes + 3600/STATUS_KEEPALIVE_INTERVAL_S));
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_mqtt_payloads"
+// End:
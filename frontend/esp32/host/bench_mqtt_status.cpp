@@ -0,0 +1,152 @@
+#include "mqtt.h"
+#include "nvs.h"
+
+#include "cJSON.h"
+#include "esp_partition.h"
+#include "mqtt_client.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Count heap allocations, to check that handling a status message does
+// not allocate
+static size_t nof_allocs = 0;
+
+extern "C" void* __libc_malloc(size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+    ++nof_allocs;
+    return __libc_malloc(size);
+}
+
+struct Message
+{
+    std::string topic;
+    std::string data;
+};
+
+/// Retained status traffic from door frontends and Bigbro devices, as
+/// published by the controller and by mqtt-loadgen
+static std::vector<Message> make_stream(int nof_doors, int nof_bigbros, int nof_messages)
+{
+    std::mt19937 rng(42);
+    struct Device
+    {
+        std::string name;
+        bool is_bigbro;
+        bool door_open = false;
+        bool locked = true;
+        bool card_present = false;
+    };
+    std::vector<Device> devices;
+    for (int i = 0; i < nof_doors; ++i)
+        devices.push_back({ "door" + std::to_string(i), false });
+    for (int i = 0; i < nof_bigbros; ++i)
+        devices.push_back({ "bigbro" + std::to_string(i), true });
+    std::vector<Message> stream;
+    char data[400];
+    for (int i = 0; i < nof_messages; ++i)
+    {
+        auto& device = devices[rng() % devices.size()];
+        // Most messages are keepalives with unchanged status
+        const bool change = rng() % 10 == 0;
+        if (device.is_bigbro)
+        {
+            device.card_present ^= change;
+            snprintf(data, sizeof(data),
+                     "{\"timestamp\": \"2026-10-17 12:00:%02d\", \"data\": {\"card_present\": %s}}",
+                     i % 60, device.card_present ? "true" : "false");
+        }
+        else
+        {
+            if (change && rng() % 2)
+                device.door_open = !device.door_open;
+            else if (change)
+                device.locked = !device.locked;
+            snprintf(data, sizeof(data),
+                     "{\"timestamp\":\"2026-10-17T12:00:%02d\",\"data\":{\"door\":\"%s\",\"space\":\"closed\","
+                     "\"lock_status\":\"%s\",\"boot_time\":\"2026-10-17T02:00:05\","
+                     "\"card_reader_heartbeat\":\"2026-10-17T12:00:00\",\"version\":\"1.2.3\"}}",
+                     i % 60, device.door_open ? "open" : "closed",
+                     device.locked ? "locked" : "unlocked");
+        }
+        stream.push_back({ "hal9k/acs/status/" + device.name, data });
+    }
+    return stream;
+}
+
+/// What handle_status() did before parse_status(): parse the whole
+/// message with cJSON and copy the fields we use
+static bool parse_with_cjson(const std::string& data, std::string& door,
+                             std::string& lock_status, int& card_present)
+{
+    auto root = cJSON_ParseWithLength(data.data(), data.size());
+    if (!root)
+        return false;
+    auto data_node = cJSON_GetObjectItem(root, "data");
+    if (data_node)
+    {
+        auto node = cJSON_GetObjectItem(data_node, "door");
+        if (cJSON_IsString(node))
+            door = node->valuestring;
+        node = cJSON_GetObjectItem(data_node, "lock_status");
+        if (cJSON_IsString(node))
+            lock_status = node->valuestring;
+        node = cJSON_GetObjectItem(data_node, "card_present");
+        if (cJSON_IsBool(node))
+            card_present = cJSON_IsTrue(node);
+    }
+    cJSON_Delete(root);
+    return true;
+}
+
+int main()
+{
+    set_identifier("main");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    init_nvs();
+    fake_partition::reset("spill", 64*1024);
+    auto& mqtt = Mqtt::instance();
+    mqtt.start(get_mqtt_address());
+    fake_mqtt::connect();
+
+    const int N = 500000;
+    const auto stream = make_stream(20, 10, N);
+
+    // Let the fleet see every device once, which allocates its entry
+    for (const auto& msg : stream)
+        fake_mqtt::deliver(msg.topic, msg.data);
+
+    const auto fleet_version = mqtt.get_fleet_version();
+    auto allocs = nof_allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& msg : stream)
+        fake_mqtt::deliver(msg.topic, msg.data);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    printf("handle_data:       %6.0f ns/message, %.2f allocations/message, %u fleet changes\n",
+           elapsed.count()/N, double(nof_allocs - allocs)/N,
+           static_cast<unsigned>(mqtt.get_fleet_version() - fleet_version));
+    printf("  open doors: %s\n  present cards: %s\n",
+           mqtt.get_open_doors().c_str(), mqtt.get_present_cards().c_str());
+
+    allocs = nof_allocs;
+    start = std::chrono::steady_clock::now();
+    std::string door, lock_status;
+    int card_present = 0, nof_ok = 0;
+    for (const auto& msg : stream)
+        nof_ok += parse_with_cjson(msg.data, door, lock_status, card_present);
+    elapsed = std::chrono::steady_clock::now() - start;
+    printf("cJSON (old parse): %6.0f ns/message, %.2f allocations/message\n",
+           elapsed.count()/N, double(nof_allocs - allocs)/N);
+    return nof_ok == N ? 0 : 1;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_mqtt_status"
+// End:
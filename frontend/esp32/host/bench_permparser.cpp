@@ -0,0 +1,52 @@
+#include "permparser.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+/// Measure parser throughput on a synthetic /v2/permissions response
+int main()
+{
+    const int NOF_CARDS = 10000;
+    std::string json = "[";
+    char item[200];
+    for (int i = 0; i < NOF_CARDS; ++i)
+    {
+        snprintf(item, sizeof(item),
+                 "%s{\"card_id\": \"%010X\", \"id\": %d, \"int_id\": %d,"
+                 " \"name\": \"Member number %d\", \"roles\": [\"door\", \"lathe\"]}",
+                 i ? ", " : "", i*7919, i, i + 100000, i);
+        json += item;
+    }
+    json += "]";
+
+    for (size_t chunk_size : { size_t(64), size_t(512), size_t(4096) })
+    {
+        const int RUNS = 20;
+        const auto start = std::chrono::steady_clock::now();
+        int nof_cards = 0;
+        for (int run = 0; run < RUNS; ++run)
+        {
+            Card_table table;
+            Permissions_parser parser(table);
+            for (size_t pos = 0; pos < json.size(); pos += chunk_size)
+                parser.add(json.data() + pos, std::min(chunk_size, json.size() - pos));
+            table.finalize();
+            if (!parser.is_complete())
+            {
+                printf("Parse failed\n");
+                return 1;
+            }
+            nof_cards = table.size();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("chunk %5zu: %d cards, %zu bytes, %.1f MB/s\n",
+               chunk_size, nof_cards, json.size(),
+               RUNS*json.size()/elapsed.count()/1e6);
+    }
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_permparser"
+// End:
@@ -0,0 +1,118 @@
+#include "format.h"
+#include "nvs.h"
+#include "signer.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/// Signing as done before Signer: initialize PSA and hash the secret for
+/// every message, and hex encode with format()
+static bool sign_from_scratch(const void* stamp, size_t stamp_size,
+                              const std::string& message, std::string& hex_hash)
+{
+    if (psa_crypto_init() != PSA_SUCCESS)
+        return false;
+    psa_hash_operation_t hash_op = PSA_HASH_OPERATION_INIT;
+    if (psa_hash_setup(&hash_op, PSA_ALG_SHA_256) != PSA_SUCCESS ||
+        psa_hash_update(&hash_op, get_private_key(), SIGNING_KEY_SIZE) != PSA_SUCCESS ||
+        psa_hash_update(&hash_op, static_cast<const uint8_t*>(stamp), stamp_size) != PSA_SUCCESS ||
+        psa_hash_update(&hash_op, reinterpret_cast<const uint8_t*>(message.c_str()),
+                        message.size()) != PSA_SUCCESS)
+    {
+        psa_hash_abort(&hash_op);
+        return false;
+    }
+    uint8_t sha[PSA_HASH_LENGTH(PSA_ALG_SHA_256)];
+    size_t sha_len;
+    if (psa_hash_finish(&hash_op, sha, sizeof(sha), &sha_len) != PSA_SUCCESS)
+        return false;
+    hex_hash.clear();
+    for (size_t i = 0; i < sha_len; ++i)
+        hex_hash += format("%02x", sha[i]);
+    return true;
+}
+
+template<typename Sign>
+static double signatures_per_second(Sign sign)
+{
+    const int N = 200000;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i)
+        if (!sign(i))
+        {
+            printf("Signing failed\n");
+            exit(1);
+        }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return N/elapsed.count();
+}
+
+int main()
+{
+    uint8_t key[SIGNING_KEY_SIZE];
+    for (int i = 0; i < SIGNING_KEY_SIZE; ++i)
+        key[i] = i*7 + 1;
+    set_identifier("bench");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    set_private_key(key);
+    init_nvs();
+
+    auto& signer = Signer::instance();
+    printf("%8s %14s %14s %14s\n", "message", "from scratch", "Signer::sign", "Signer::verify");
+    for (size_t size : { size_t(20), size_t(100), size_t(400) })
+    {
+        const std::string message(size, 'x');
+        // Both ways must agree
+        const time_t stamp = 1700000000;
+        std::string expected;
+        char hex[Signer::HEX_SIZE];
+        if (!sign_from_scratch(&stamp, sizeof(stamp), message, expected) ||
+            !signer.sign(&stamp, sizeof(stamp), message.data(), message.size(), hex) ||
+            expected != hex ||
+            !signer.verify(&stamp, sizeof(stamp), message.data(), message.size(), hex))
+        {
+            printf("Signatures differ\n");
+            return 1;
+        }
+
+        std::string hex_hash;
+        const auto scratch = signatures_per_second([&](time_t now)
+        {
+            return sign_from_scratch(&now, sizeof(now), message, hex_hash);
+        });
+        const auto sign = signatures_per_second([&](time_t now)
+        {
+            return signer.sign(&now, sizeof(now), message.data(), message.size(), hex);
+        });
+        const auto verify = signatures_per_second([&](time_t)
+        {
+            return signer.verify(&stamp, sizeof(stamp), message.data(), message.size(), expected.c_str());
+        });
+        printf("%8zu %12.0f/s %12.0f/s %12.0f/s\n", size, scratch, sign, verify);
+    }
+
+    // A new key takes effect without a reboot
+    const time_t stamp = 1700000000;
+    const std::string message = "after key change";
+    char old_hex[Signer::HEX_SIZE], new_hex[Signer::HEX_SIZE];
+    std::string expected;
+    signer.sign(&stamp, sizeof(stamp), message.data(), message.size(), old_hex);
+    key[0] ^= 0xFF;
+    set_private_key(key);
+    if (!signer.sign(&stamp, sizeof(stamp), message.data(), message.size(), new_hex) ||
+        !sign_from_scratch(&stamp, sizeof(stamp), message, expected) ||
+        expected != new_hex || expected == old_hex)
+    {
+        printf("Key change ignored\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ./build/bench_signer"
+// End:
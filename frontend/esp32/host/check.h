@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdio.h>
+
+/// Minimal test support. CHECK() reports a failed condition and carries
+/// on; main() returns check_result().
+
+inline int check_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond))                                                    \
+        {                                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            ++check_failures;                                           \
+        }                                                               \
+    } while (0)
+
+inline int check_result()
+{
+    if (check_failures)
+        fprintf(stderr, "%d check(s) failed\n", check_failures);
+    return check_failures ? 1 : 0;
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ctest --test-dir build"
+// End:
@@ -0,0 +1,113 @@
+#pragma once
+
+// Host stand-in for the TFT_eSPI library. Nothing is drawn, but the text
+// on screen is kept, so tests can check what is shown.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#define TFT_WIDTH 240
+#define TFT_HEIGHT 320
+
+#define TFT_BLACK 0x0000
+#define TFT_BLUE 0x001F
+#define TFT_RED 0xF800
+#define TFT_GREEN 0x07E0
+#define TFT_CYAN 0x07FF
+#define TFT_YELLOW 0xFFE0
+#define TFT_WHITE 0xFFFF
+#define TFT_ORANGE 0xFDA0
+#define TFT_OLIVE 0x7BE0
+
+struct GFXfont
+{
+    uint8_t yAdvance;
+};
+
+inline const GFXfont FreeSans9pt7b = { 22 };
+inline const GFXfont FreeSans12pt7b = { 29 };
+inline const GFXfont FreeSansBold18pt7b = { 42 };
+
+class TFT_eSPI
+{
+public:
+    void init()
+    {
+    }
+
+    void setRotation(uint8_t)
+    {
+    }
+
+    void setTextColor(uint16_t)
+    {
+    }
+
+    void setFreeFont(const GFXfont* f)
+    {
+        font = f;
+    }
+
+    int16_t fontHeight(int16_t)
+    {
+        return font->yAdvance;
+    }
+
+    /// Roughly the average character width of the fonts
+    int16_t textWidth(const char* s, uint8_t)
+    {
+        return strlen(s)*font->yAdvance*2/5;
+    }
+
+    void drawString(const char* s, int32_t x, int32_t y, uint8_t)
+    {
+        text[{ y, x }] = s;
+    }
+
+    /// Erases text that starts inside the rectangle
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t)
+    {
+        for (auto it = text.begin(); it != text.end(); )
+        {
+            const auto [ty, tx] = it->first;
+            if (tx >= x && tx < x + w && ty >= y && ty < y + h)
+                it = text.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    void fillScreen(uint32_t)
+    {
+        text.clear();
+    }
+
+    /// Host only. Text on screen, top to bottom. Strings drawn on the same
+    /// row are separated by a space, and rows by a newline.
+    std::string get_text() const
+    {
+        std::string s;
+        int32_t last_y = -1;
+        for (const auto& [pos, str] : text)
+        {
+            if (!s.empty())
+                s += pos.first == last_y ? " " : "\n";
+            s += str;
+            last_y = pos.first;
+        }
+        return s;
+    }
+
+private:
+    const GFXfont* font = &FreeSans12pt7b;
+    /// (y, x) -> string drawn there
+    std::map<std::pair<int32_t, int32_t>, std::string> text;
+};
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
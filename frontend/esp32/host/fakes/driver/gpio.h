@@ -0,0 +1,43 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name. Input levels are
+// set by the program with fake_gpio::set_level(), which runs the pin's
+// interrupt handler on every edge, in the calling thread.
+
+#include "esp_err.h"
+
+#include <stdint.h>
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+} gpio_int_type_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+
+/// Returns ESP_ERR_INVALID_STATE if already installed
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t intr_type);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr_handler, void* args);
+
+namespace fake_gpio
+{
+
+/// Forget levels and handlers. Pins read as 0 until set.
+void reset();
+
+/// Set input level, as if driven from outside
+void set_level(gpio_num_t pin, int level);
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd ../.. && cmake -S . -B build && cmake --build build"
+// End:
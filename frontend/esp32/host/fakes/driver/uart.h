@@ -0,0 +1,11 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include "esp_err.h"
+
+typedef int uart_port_t;
+
+// Local Variables:
+// compile-command: "cd ../.. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+typedef struct {
+    char version[32];
+    char project_name[32];
+} esp_app_desc_t;
+
+inline const esp_app_desc_t* esp_app_get_description()
+{
+    static const esp_app_desc_t desc = { "host", "frontend" };
+    return &desc;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,9 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#define IRAM_ATTR
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
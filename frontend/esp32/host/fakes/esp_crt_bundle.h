@@ -0,0 +1,14 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include "esp_err.h"
+
+inline esp_err_t esp_crt_bundle_attach(void*)
+{
+    return ESP_OK;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+/// Always 0, as the host heap is not limited
+inline size_t heap_caps_get_free_size(uint32_t)
+{
+    return 0;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
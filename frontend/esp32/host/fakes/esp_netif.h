@@ -0,0 +1,24 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+    /// Network byte order
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+inline char* esp_ip4addr_ntoa(const esp_ip4_addr_t* addr, char* buf, int buflen)
+{
+    const auto a = addr->addr;
+    snprintf(buf, buflen, "%u.%u.%u.%u", static_cast<unsigned>(a & 0xFF),
+             static_cast<unsigned>((a >> 8) & 0xFF), static_cast<unsigned>((a >> 16) & 0xFF),
+             static_cast<unsigned>(a >> 24));
+    return buf;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
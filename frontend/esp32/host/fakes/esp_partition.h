@@ -0,0 +1,68 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name. Partitions are
+// backed by RAM, and found by label. Writes behave like NOR flash: erase
+// sets bytes to 0xFF, and writes can only clear bits.
+
+#include "esp_err.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef enum {
+    ESP_PARTITION_MMAP_DATA,
+    ESP_PARTITION_MMAP_INST,
+} esp_partition_mmap_memory_t;
+
+typedef uint32_t esp_partition_mmap_handle_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    size_t address;
+    size_t size;
+    char label[17];
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label);
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory,
+                             const void** out_ptr, esp_partition_mmap_handle_t* out_handle);
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size);
+
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size);
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size);
+
+namespace fake_partition
+{
+
+/// (Re)create the partition with the given label, erased
+void reset(const char* label, size_t size);
+
+/// Number of bytes that can still be erased or written before the
+/// simulated power loss. Negative means no limit. Once it reaches zero,
+/// erase and write change nothing more and return ESP_FAIL.
+inline long budget = -1;
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name. The sequence is
+// the same in every run, so tests are repeatable.
+
+#include <stdint.h>
+
+inline uint32_t esp_random()
+{
+    static uint32_t state = 1;
+    state = state*1664525 + 1013904223;
+    return state;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,30 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+
+namespace fake_sntp
+{
+
+inline sntp_sync_time_cb_t callback = nullptr;
+
+/// Report that the wall clock has been set
+inline void sync()
+{
+    if (callback)
+        callback(nullptr);
+}
+
+} // end namespace
+
+inline void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+    fake_sntp::callback = callback;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,31 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include "esp_err.h"
+// Included indirectly by the real header
+#include "esp_heap_caps.h"
+
+#include <stdint.h>
+
+/// Throws fake_system::Restart
+[[noreturn]] void esp_restart();
+
+/// Always 0, as the host heap is not limited
+inline uint32_t esp_get_free_heap_size()
+{
+    return 0;
+}
+
+namespace fake_system
+{
+
+struct Restart
+{
+};
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
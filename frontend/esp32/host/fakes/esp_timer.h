@@ -0,0 +1,64 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name.
+//
+// esp_timer_get_time() follows the host's monotonic clock, until
+// fake_clock::set_virtual() is called. From then on time only moves when
+// the program advances it, and timer callbacks run as it does. Timers
+// never fire on the host's clock.
+
+#include "esp_err.h"
+
+#include <stdint.h>
+
+#include <functional>
+
+typedef struct Fake_timer* esp_timer_handle_t;
+
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time();
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args,
+                           esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+namespace fake_clock
+{
+
+/// Switch to virtual time, starting at now_us
+void set_virtual(int64_t now_us);
+
+bool is_virtual();
+
+/// Run fn when virtual time reaches at_us
+void schedule(int64_t at_us, std::function<void()> fn);
+
+/// Time of next timer or scheduled function, or INT64_MAX if none
+int64_t next_due();
+
+/// Advance virtual time to at_us, running timers and scheduled functions
+/// that become due, in order
+void advance_to(int64_t at_us);
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,21 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include "esp_err.h"
+
+typedef struct esp_tls_last_error* esp_tls_error_handle_t;
+
+inline esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t, int* esp_tls_code,
+                                                  int* esp_tls_flags)
+{
+    if (esp_tls_code)
+        *esp_tls_code = 0;
+    if (esp_tls_flags)
+        *esp_tls_flags = 0;
+    return ESP_OK;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
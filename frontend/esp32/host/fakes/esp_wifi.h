@@ -0,0 +1,15 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#include "esp_err.h"
+
+inline esp_err_t esp_wifi_sta_get_rssi(int* rssi)
+{
+    *rssi = -50;
+    return ESP_OK;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,53 @@
+#include "fake_cardreader.h"
+
+#include "controller.h"
+
+static std::mutex mutex;
+static Card_reader::Card_id swiped = 0;
+static std::atomic<Card_reader::Pattern> last_pattern = Card_reader::Pattern::none;
+
+Card_reader& Card_reader::instance()
+{
+    static Card_reader the_instance;
+    return the_instance;
+}
+
+void Card_reader::set_pattern(Pattern p)
+{
+    last_pattern = p;
+}
+
+void Card_reader::set_sound(Sound)
+{
+}
+
+Card_reader::Card_id Card_reader::get_and_clear_card_id()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    Card_id id = 0;
+    std::swap(id, swiped);
+    return id;
+}
+
+namespace fake_card_reader
+{
+
+void swipe(Card_reader::Card_id id)
+{
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        swiped = id;
+    }
+    Controller::notify(Controller::EVENT_CARD);
+}
+
+Card_reader::Pattern get_pattern()
+{
+    return last_pattern;
+}
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
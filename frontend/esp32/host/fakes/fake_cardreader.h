@@ -0,0 +1,21 @@
+#pragma once
+
+// Host replacement of main/cardreader.cpp. There is no reader task; cards
+// are swiped by the program.
+
+#include "cardreader.h"
+
+namespace fake_card_reader
+{
+
+/// Swipe card, and notify the controller as the reader task does
+void swipe(Card_reader::Card_id id);
+
+/// Last pattern set by the controller
+Card_reader::Pattern get_pattern();
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,23 @@
+// Host replacement of main/connect.cpp. Always connected.
+
+#include "connect.h"
+
+bool connect(const wifi_creds_t&)
+{
+    return true;
+}
+
+esp_err_t disconnect()
+{
+    return ESP_OK;
+}
+
+esp_ip4_addr_t get_ip_address()
+{
+    // 127.0.0.1
+    return { 0x0100007F };
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
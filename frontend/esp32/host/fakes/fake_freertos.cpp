@@ -0,0 +1,252 @@
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "esp_timer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct Fake_task
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t value = 0;
+    bool pending = false;
+};
+
+static constexpr int64_t US_PER_TICK = portTICK_PERIOD_MS*1000;
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    // Never freed, as other tasks may hold the handle
+    thread_local auto task = new Fake_task;
+    return task;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    {
+        std::lock_guard<std::mutex> g(task->mutex);
+        switch (action)
+        {
+        case eNoAction:
+            break;
+        case eSetBits:
+            task->value |= value;
+            break;
+        case eIncrement:
+            ++task->value;
+            break;
+        case eSetValueWithOverwrite:
+            task->value = value;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (task->pending)
+                return pdFAIL;
+            task->value = value;
+            break;
+        }
+        task->pending = true;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t* higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+/// Wait until the current task has a pending notification, or ticks have
+/// passed. Returns with the task's mutex held if notified.
+static bool wait(std::unique_lock<std::mutex>& lock, TickType_t ticks)
+{
+    auto task = xTaskGetCurrentTaskHandle();
+    if (!fake_clock::is_virtual())
+    {
+        if (ticks == portMAX_DELAY)
+            task->cv.wait(lock, [task] { return task->pending; });
+        else
+            task->cv.wait_for(lock, std::chrono::microseconds(ticks*US_PER_TICK),
+                              [task] { return task->pending; });
+        return task->pending;
+    }
+    const int64_t end = ticks == portMAX_DELAY ? INT64_MAX : esp_timer_get_time() + ticks*US_PER_TICK;
+    while (!task->pending)
+    {
+        const auto next = std::min(end, fake_clock::next_due());
+        if (next == INT64_MAX)
+            // Nothing will ever happen
+            return false;
+        // Whatever runs may notify us
+        lock.unlock();
+        fake_clock::advance_to(next);
+        lock.lock();
+        if (next >= end)
+            break;
+    }
+    return task->pending;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit,
+                           uint32_t* notification_value, TickType_t ticks_to_wait)
+{
+    auto task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    if (!task->pending)
+        task->value &= ~bits_to_clear_on_entry;
+    const bool notified = wait(lock, ticks_to_wait);
+    if (notification_value)
+        *notification_value = task->value;
+    if (!notified)
+        return pdFALSE;
+    task->value &= ~bits_to_clear_on_exit;
+    task->pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait)
+{
+    auto task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    if (!task->value)
+    {
+        task->pending = false;
+        wait(lock, ticks_to_wait);
+    }
+    const auto value = task->value;
+    if (value)
+        task->value = clear_count_on_exit ? 0 : value - 1;
+    task->pending = false;
+    return value;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (fake_clock::is_virtual())
+        fake_clock::advance_to(esp_timer_get_time() + ticks*US_PER_TICK);
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(ticks*US_PER_TICK));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return esp_timer_get_time()/US_PER_TICK;
+}
+
+struct Fake_queue
+{
+    std::mutex mutex;
+    size_t length;
+    size_t item_size;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    auto queue = new Fake_queue;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t)
+{
+    std::lock_guard<std::mutex> g(queue->mutex);
+    if (queue->items.size() >= queue->length)
+        return pdFAIL;
+    const auto p = static_cast<const uint8_t*>(item);
+    queue->items.emplace_back(p, p + queue->item_size);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item,
+                             BaseType_t* higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t)
+{
+    std::lock_guard<std::mutex> g(queue->mutex);
+    if (queue->items.empty())
+        return pdFALSE;
+    memcpy(buffer, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+struct Fake_rtos_timer
+{
+    esp_timer_handle_t timer;
+    TickType_t period;
+    bool auto_reload;
+    void* id;
+    TimerCallbackFunction_t callback;
+};
+
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t auto_reload,
+                           void* timer_id, TimerCallbackFunction_t callback)
+{
+    auto timer = new Fake_rtos_timer{ nullptr, period, auto_reload != 0, timer_id, callback };
+    const esp_timer_create_args_t args = {
+        .callback = [](void* arg)
+        {
+            auto timer = static_cast<Fake_rtos_timer*>(arg);
+            timer->callback(timer);
+        },
+        .arg = timer,
+        .name = name,
+    };
+    esp_timer_create(&args, &timer->timer);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t)
+{
+    // Starting a running timer restarts it
+    const uint64_t period_us = timer->period*US_PER_TICK;
+    if (timer->auto_reload)
+        esp_timer_start_periodic(timer->timer, period_us);
+    else
+        esp_timer_start_once(timer->timer, period_us);
+    return pdPASS;
+}
+
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t* higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return xTimerStart(timer, 0);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t)
+{
+    esp_timer_stop(timer->timer);
+    return pdPASS;
+}
+
+void* pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
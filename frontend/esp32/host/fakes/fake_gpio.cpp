@@ -0,0 +1,96 @@
+#include "driver/gpio.h"
+
+#include <map>
+#include <mutex>
+
+struct Pin
+{
+    int level = 0;
+    gpio_int_type_t intr_type = GPIO_INTR_DISABLE;
+    gpio_isr_t handler = nullptr;
+    void* arg = nullptr;
+};
+
+static std::mutex mutex;
+static std::map<gpio_num_t, Pin> pins;
+static bool isr_service_installed = false;
+
+int gpio_get_level(gpio_num_t pin)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return pins[pin].level;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    pins[pin].level = level ? 1 : 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    if (isr_service_installed)
+        return ESP_ERR_INVALID_STATE;
+    isr_service_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t intr_type)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    pins[pin].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr_handler, void* args)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    auto& p = pins[pin];
+    p.handler = isr_handler;
+    p.arg = args;
+    return ESP_OK;
+}
+
+namespace fake_gpio
+{
+
+void reset()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    pins.clear();
+    isr_service_installed = false;
+}
+
+void set_level(gpio_num_t pin, int level)
+{
+    gpio_isr_t handler = nullptr;
+    void* arg = nullptr;
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        auto& p = pins[pin];
+        level = level ? 1 : 0;
+        if (level == p.level)
+            return;
+        p.level = level;
+        const bool rising = level;
+        if (p.handler && isr_service_installed &&
+            (p.intr_type == GPIO_INTR_ANYEDGE ||
+             (p.intr_type == GPIO_INTR_POSEDGE && rising) ||
+             (p.intr_type == GPIO_INTR_NEGEDGE && !rising)))
+        {
+            handler = p.handler;
+            arg = p.arg;
+        }
+    }
+    // The handler reads the level
+    if (handler)
+        handler(arg);
+}
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
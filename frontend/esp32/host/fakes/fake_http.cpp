@@ -0,0 +1,143 @@
+#include "esp_http_client.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+struct esp_http_client
+{
+    esp_http_client_config_t config;
+    std::map<std::string, std::string> headers;
+    int status = 0;
+};
+
+static std::mutex mutex;
+static int response_status = 0;
+static std::string response_body;
+static std::string response_etag;
+static int nof_requests = 0;
+static size_t nof_bytes = 0;
+
+// Size of the pieces the body is passed to the event handler in
+static constexpr size_t CHUNK_SIZE = 512;
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config)
+{
+    return new esp_http_client{ *config };
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t, esp_http_client_method_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value)
+{
+    client->headers[key] = value;
+    return ESP_OK;
+}
+
+static void send_event(esp_http_client_handle_t client, esp_http_client_event_t& event)
+{
+    event.client = client;
+    event.user_data = client->config.user_data;
+    if (client->config.event_handler)
+        client->config.event_handler(&event);
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    int status;
+    std::string body, etag;
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        ++nof_requests;
+        status = response_status;
+        body = response_body;
+        etag = response_etag;
+    }
+    if (!status)
+        return ESP_FAIL;
+    const auto it = client->headers.find("If-None-Match");
+    if (!etag.empty() && it != client->headers.end() && it->second == etag)
+    {
+        client->status = 304;
+        return ESP_OK;
+    }
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        nof_bytes += body.size();
+    }
+    client->status = status;
+    if (!etag.empty())
+    {
+        esp_http_client_event_t event = {};
+        event.event_id = HTTP_EVENT_ON_HEADER;
+        char key[] = "ETag";
+        event.header_key = key;
+        event.header_value = etag.data();
+        send_event(client, event);
+    }
+    for (size_t pos = 0; pos < body.size(); pos += CHUNK_SIZE)
+    {
+        esp_http_client_event_t event = {};
+        event.event_id = HTTP_EVENT_ON_DATA;
+        event.data = body.data() + pos;
+        event.data_len = std::min(CHUNK_SIZE, body.size() - pos);
+        send_event(client, event);
+    }
+    esp_http_client_event_t event = {};
+    event.event_id = HTTP_EVENT_ON_FINISH;
+    send_event(client, event);
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t)
+{
+    return false;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    delete client;
+    return ESP_OK;
+}
+
+namespace fake_http
+{
+
+void set_response(int status, const std::string& body, const std::string& etag)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    response_status = status;
+    response_body = body;
+    response_etag = etag;
+}
+
+int get_nof_requests()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return nof_requests;
+}
+
+size_t get_nof_bytes()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return nof_bytes;
+}
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,59 @@
+#include "fake_hw.h"
+#include "defs.h"
+
+#include "esp_timer.h"
+
+#include <atomic>
+
+/// Wall clock minus esp_timer_get_time(), in microseconds
+static std::atomic<int64_t> wall_offset_us = 0;
+
+void init_hardware()
+{
+    // Buttons are active low, and the door is closed
+    for (auto pin : { PIN_RED, PIN_WHITE, PIN_GREEN, PIN_LEAVE })
+        gpio_set_level(pin, 1);
+    gpio_set_level(PIN_DOOR, 0);
+    gpio_set_level(PIN_RELAY, 0);
+}
+
+void set_relay(bool on)
+{
+    gpio_set_level(PIN_RELAY, on);
+}
+
+bool get_door_open()
+{
+    return gpio_get_level(PIN_DOOR);
+}
+
+int64_t get_monotonic_us()
+{
+    return esp_timer_get_time();
+}
+
+time_t get_wall_time()
+{
+    if (!fake_clock::is_virtual())
+        return time(nullptr);
+    return (esp_timer_get_time() + wall_offset_us)/1000000;
+}
+
+namespace fake_hw
+{
+
+bool get_relay()
+{
+    return gpio_get_level(PIN_RELAY);
+}
+
+void set_wall_time(time_t t)
+{
+    wall_offset_us = static_cast<int64_t>(t)*1000000 - esp_timer_get_time();
+}
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
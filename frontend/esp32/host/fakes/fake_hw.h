@@ -0,0 +1,22 @@
+#pragma once
+
+// Host replacement of main/hw.cpp. The relay and the door sensor are
+// GPIO pins of driver/gpio.h. The wall clock follows the host's clock
+// until fake_clock::set_virtual() is called, and from then on moves with
+// virtual time.
+
+#include "hw.h"
+
+namespace fake_hw
+{
+
+bool get_relay();
+
+/// Set wall clock, from now on
+void set_wall_time(time_t t);
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
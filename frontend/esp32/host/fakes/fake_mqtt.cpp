@@ -0,0 +1,124 @@
+#include "mqtt_client.h"
+
+#include <string.h>
+
+#include <mutex>
+
+struct esp_mqtt_client
+{
+    esp_event_handler_t handler = nullptr;
+    void* handler_arg = nullptr;
+    int next_msg_id = 1;
+    int outbox_size = 0;
+    std::vector<std::string> subscriptions;
+    std::vector<fake_mqtt::Message> published;
+};
+
+static esp_mqtt_client the_client;
+static std::mutex mutex;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t*)
+{
+    return &the_client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t,
+                                         esp_event_handler_t event_handler,
+                                         void* event_handler_arg)
+{
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t)
+{
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    client->subscriptions.push_back(topic);
+    return client->next_msg_id++;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic,
+                            const char* data, int len, int qos, int retain, bool)
+{
+    if (!client)
+        return -1;
+    std::lock_guard<std::mutex> g(mutex);
+    if (len <= 0)
+        len = data ? strlen(data) : 0;
+    client->published.push_back({ topic, std::string(data, len), qos, retain != 0 });
+    return client->next_msg_id++;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return client ? client->outbox_size : 0;
+}
+
+namespace fake_mqtt
+{
+
+std::vector<Message> take_published()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return std::move(the_client.published);
+}
+
+std::vector<std::string> get_subscriptions()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return the_client.subscriptions;
+}
+
+void set_outbox_size(int size)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    the_client.outbox_size = size;
+}
+
+static void send_event(esp_mqtt_event_t& event)
+{
+    event.client = &the_client;
+    if (the_client.handler)
+        the_client.handler(the_client.handler_arg, "MQTT_EVENTS", event.event_id, &event);
+}
+
+void connect()
+{
+    esp_mqtt_event_t event = {};
+    event.event_id = MQTT_EVENT_CONNECTED;
+    send_event(event);
+}
+
+void disconnect()
+{
+    esp_mqtt_event_t event = {};
+    event.event_id = MQTT_EVENT_DISCONNECTED;
+    send_event(event);
+}
+
+void deliver(std::string_view topic, std::string_view data)
+{
+    esp_mqtt_event_t event = {};
+    event.event_id = MQTT_EVENT_DATA;
+    // The client passes pointers into its receive buffer
+    event.topic = const_cast<char*>(topic.data());
+    event.topic_len = topic.size();
+    event.data = const_cast<char*>(data.data());
+    event.data_len = data.size();
+    event.total_data_len = data.size();
+    send_event(event);
+}
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,90 @@
+#include "nvs_flash.h"
+
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+static std::map<std::string, std::vector<uint8_t>> values;
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase()
+{
+    values.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char*, nvs_open_mode_t, nvs_handle_t* out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t)
+{
+}
+
+static esp_err_t set(const char* key, const void* value, size_t length)
+{
+    const auto bytes = static_cast<const uint8_t*>(value);
+    values[key].assign(bytes, bytes + length);
+    return ESP_OK;
+}
+
+/// If out_value is null, only the length is returned
+static esp_err_t get(const char* key, void* out_value, size_t* length)
+{
+    const auto it = values.find(key);
+    if (it == values.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    const auto& value = it->second;
+    if (out_value)
+    {
+        if (*length < value.size())
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out_value, value.data(), value.size());
+    }
+    *length = value.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t, const char* key, char* out_value, size_t* length)
+{
+    return get(key, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t, const char* key, const char* value)
+{
+    // Including the terminator
+    return set(key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t, const char* key, void* out_value, size_t* length)
+{
+    return get(key, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t, const char* key, const void* value, size_t length)
+{
+    return set(key, value, length);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t, const char* key, uint8_t* out_value)
+{
+    size_t length = sizeof(*out_value);
+    return get(key, out_value, &length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t, const char* key, uint8_t value)
+{
+    return set(key, &value, sizeof(value));
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,125 @@
+#include "esp_partition.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+struct Fake_partition
+{
+    esp_partition_t partition;
+    std::vector<uint8_t> flash;
+};
+
+// A list, so that partition pointers stay valid
+static std::list<Fake_partition> partitions;
+
+static Fake_partition* find(const esp_partition_t* partition)
+{
+    for (auto& p : partitions)
+        if (&p.partition == partition)
+            return &p;
+    return nullptr;
+}
+
+namespace fake_partition
+{
+
+void reset(const char* label, size_t size)
+{
+    Fake_partition* p = nullptr;
+    for (auto& existing : partitions)
+        if (!strcmp(existing.partition.label, label))
+            p = &existing;
+    if (!p)
+        p = &partitions.emplace_back();
+    p->partition.type = ESP_PARTITION_TYPE_DATA;
+    p->partition.size = size;
+    snprintf(p->partition.label, sizeof(p->partition.label), "%s", label);
+    p->flash.assign(size, 0xFF);
+    budget = -1;
+}
+
+} // end namespace
+
+/// Use up budget for size bytes. Returns the number of bytes that may be
+/// changed.
+static size_t spend(size_t size)
+{
+    if (fake_partition::budget < 0)
+        return size;
+    const size_t n = std::min<size_t>(size, fake_partition::budget);
+    fake_partition::budget -= n;
+    return n;
+}
+
+/// Returns flash of partition if offset and size are within it
+static uint8_t* get_flash(const esp_partition_t* partition, size_t offset, size_t size)
+{
+    auto p = find(partition);
+    if (!p || offset > p->flash.size() || size > p->flash.size() - offset)
+        return nullptr;
+    return p->flash.data();
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t,
+                                                const char* label)
+{
+    for (auto& p : partitions)
+        if (p.partition.type == type && (!label || !strcmp(p.partition.label, label)))
+            return &p.partition;
+    return nullptr;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t,
+                             const void** out_ptr, esp_partition_mmap_handle_t* out_handle)
+{
+    const auto flash = get_flash(partition, offset, size);
+    if (!flash)
+        return ESP_ERR_INVALID_ARG;
+    *out_ptr = flash + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size)
+{
+    const auto flash = get_flash(partition, src_offset, size);
+    if (!flash)
+        return ESP_ERR_INVALID_ARG;
+    memcpy(dst, flash + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size)
+{
+    const auto flash = get_flash(partition, dst_offset, size);
+    if (!flash)
+        return ESP_ERR_INVALID_ARG;
+    const auto n = spend(size);
+    const auto bytes = static_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < n; ++i)
+        flash[dst_offset + i] &= bytes[i];
+    return n == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size)
+{
+    const auto flash = get_flash(partition, offset, size);
+    if (!flash)
+        return ESP_ERR_INVALID_ARG;
+    const auto n = spend(size);
+    memset(flash + offset, 0xFF, n);
+    return n == size ? ESP_OK : ESP_FAIL;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
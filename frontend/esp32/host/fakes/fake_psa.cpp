@@ -0,0 +1,75 @@
+#include "psa/crypto.h"
+
+#include <openssl/evp.h>
+
+static EVP_MD_CTX* ctx(const psa_hash_operation_t* operation)
+{
+    return static_cast<EVP_MD_CTX*>(operation->ctx);
+}
+
+psa_status_t psa_crypto_init()
+{
+    return PSA_SUCCESS;
+}
+
+psa_status_t psa_hash_setup(psa_hash_operation_t* operation, psa_algorithm_t alg)
+{
+    if (alg != PSA_ALG_SHA_256)
+        return PSA_ERROR_NOT_SUPPORTED;
+    if (operation->ctx)
+        return PSA_ERROR_BAD_STATE;
+    operation->ctx = EVP_MD_CTX_new();
+    if (!EVP_DigestInit_ex(ctx(operation), EVP_sha256(), nullptr))
+    {
+        psa_hash_abort(operation);
+        return PSA_ERROR_GENERIC_ERROR;
+    }
+    return PSA_SUCCESS;
+}
+
+psa_status_t psa_hash_update(psa_hash_operation_t* operation,
+                             const uint8_t* input, size_t input_length)
+{
+    if (!operation->ctx)
+        return PSA_ERROR_BAD_STATE;
+    return EVP_DigestUpdate(ctx(operation), input, input_length) ? PSA_SUCCESS : PSA_ERROR_GENERIC_ERROR;
+}
+
+psa_status_t psa_hash_finish(psa_hash_operation_t* operation,
+                             uint8_t* hash, size_t hash_size, size_t* hash_length)
+{
+    if (!operation->ctx)
+        return PSA_ERROR_BAD_STATE;
+    if (hash_size < PSA_HASH_LENGTH(PSA_ALG_SHA_256))
+        return PSA_ERROR_BUFFER_TOO_SMALL;
+    unsigned int length = 0;
+    const bool ok = EVP_DigestFinal_ex(ctx(operation), hash, &length);
+    *hash_length = length;
+    psa_hash_abort(operation);
+    return ok ? PSA_SUCCESS : PSA_ERROR_GENERIC_ERROR;
+}
+
+psa_status_t psa_hash_clone(const psa_hash_operation_t* source_operation,
+                            psa_hash_operation_t* target_operation)
+{
+    if (!source_operation->ctx || target_operation->ctx)
+        return PSA_ERROR_BAD_STATE;
+    target_operation->ctx = EVP_MD_CTX_new();
+    if (!EVP_MD_CTX_copy_ex(ctx(target_operation), ctx(source_operation)))
+    {
+        psa_hash_abort(target_operation);
+        return PSA_ERROR_GENERIC_ERROR;
+    }
+    return PSA_SUCCESS;
+}
+
+psa_status_t psa_hash_abort(psa_hash_operation_t* operation)
+{
+    EVP_MD_CTX_free(ctx(operation));
+    operation->ctx = nullptr;
+    return PSA_SUCCESS;
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,10 @@
+#include "esp_system.h"
+
+void esp_restart()
+{
+    throw fake_system::Restart();
+}
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,130 @@
+#include "esp_timer.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+
+struct Fake_timer
+{
+    esp_timer_create_args_t args;
+    /// 0 for one-shot
+    uint64_t period = 0;
+    /// Generation of the pending run, so that stale runs are ignored
+    /// when the timer is restarted or stopped
+    int generation = 0;
+};
+
+static std::recursive_mutex mutex;
+static bool is_virtual_time = false;
+static int64_t virtual_now = 0;
+/// Time -> function. Functions due at the same time run in the order
+/// they were scheduled.
+static std::multimap<int64_t, std::function<void()>> due;
+
+int64_t esp_timer_get_time()
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    if (is_virtual_time)
+        return virtual_now;
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void schedule_run(Fake_timer* timer, int64_t at_us)
+{
+    const int generation = ++timer->generation;
+    fake_clock::schedule(at_us, [timer, generation]()
+    {
+        if (timer->generation != generation)
+            return;
+        if (timer->period)
+            schedule_run(timer, virtual_now + timer->period);
+        timer->args.callback(timer->args.arg);
+    });
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args,
+                           esp_timer_handle_t* out_handle)
+{
+    *out_handle = new Fake_timer{ *create_args };
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    timer->period = 0;
+    schedule_run(timer, virtual_now + timeout_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    timer->period = period;
+    schedule_run(timer, virtual_now + period);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    ++timer->generation;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    // Pending runs may still refer to it
+    esp_timer_stop(timer);
+    timer->args.callback = [](void*) {};
+    return ESP_OK;
+}
+
+namespace fake_clock
+{
+
+void set_virtual(int64_t now_us)
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    is_virtual_time = true;
+    virtual_now = now_us;
+}
+
+bool is_virtual()
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    return is_virtual_time;
+}
+
+void schedule(int64_t at_us, std::function<void()> fn)
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    due.emplace(at_us, std::move(fn));
+}
+
+int64_t next_due()
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    return due.empty() ? INT64_MAX : due.begin()->first;
+}
+
+void advance_to(int64_t at_us)
+{
+    std::lock_guard<std::recursive_mutex> g(mutex);
+    while (!due.empty() && due.begin()->first <= at_us)
+    {
+        const auto it = due.begin();
+        virtual_now = std::max(virtual_now, it->first);
+        const auto fn = std::move(it->second);
+        due.erase(it);
+        fn();
+    }
+    virtual_now = std::max(virtual_now, at_us);
+}
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
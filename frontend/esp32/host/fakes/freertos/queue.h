@@ -0,0 +1,22 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS header of the same name. Queues never
+// block: sending to a full queue and receiving from an empty one fail at
+// once, whatever the timeout.
+
+#include "FreeRTOS.h"
+
+typedef struct Fake_queue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait);
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item,
+                             BaseType_t* higher_priority_task_woken);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait);
+
+// Local Variables:
+// compile-command: "cd ../.. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,42 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS header of the same name. Each host
+// thread is a task. Task notifications work across threads. With
+// fake_clock::is_virtual(), waiting advances virtual time instead of
+// blocking, as there is then only one thread.
+
+#include "FreeRTOS.h"
+
+typedef struct Fake_task* TaskHandle_t;
+
+typedef enum {
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t* higher_priority_task_woken);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit,
+                           uint32_t* notification_value, TickType_t ticks_to_wait);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount();
+
+#define portYIELD_FROM_ISR(x) ((void) (x))
+
+// Local Variables:
+// compile-command: "cd ../.. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,25 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS header of the same name. Timers are
+// esp_timer timers, so they only fire in virtual time.
+
+#include "FreeRTOS.h"
+
+typedef struct Fake_rtos_timer* TimerHandle_t;
+
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t auto_reload,
+                           void* timer_id, TimerCallbackFunction_t callback);
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t* higher_priority_task_woken);
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
+
+void* pvTimerGetTimerID(TimerHandle_t timer);
+
+// Local Variables:
+// compile-command: "cd ../.. && cmake -S . -B build && cmake --build build"
+// End:
@@ -0,0 +1,119 @@
+#pragma once
+
+// Host stand-in for the esp-mqtt header of the same name. There is a
+// single client, which never talks to a broker: enqueued messages are
+// recorded, and the program makes the client connect and deliver
+// messages through fake_mqtt.
+
+#include "esp_event.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
+
+typedef enum esp_mqtt_event_id_t {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef struct esp_mqtt_event_t {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char* data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    char* topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+    bool retain;
+    int qos;
+    bool dup;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef struct esp_mqtt_client_config_t {
+    struct {
+        struct {
+            const char* uri;
+        } address;
+    } broker;
+    struct {
+        struct {
+            const char* topic;
+            const char* msg;
+            int msg_len;
+            int qos;
+            int retain;
+        } last_will;
+        int keepalive;
+    } session;
+    struct {
+        uint64_t limit;
+    } outbox;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config);
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler,
+                                         void* event_handler_arg);
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int qos);
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic,
+                            const char* data, int len, int qos, int retain, bool store);
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+
+namespace fake_mqtt
+{
+
+struct Message
+{
+    std::string topic;
+    std::string data;
+    int qos = 0;
+    bool retain = false;
+};
+
+/// Messages enqueued since the last call
+std::vector<Message> take_published();
+
+/// Topic filters subscribed to
+std::vector<std::string> get_subscriptions();
+
+/// Value returned by esp_mqtt_client_get_outbox_size()
+void set_outbox_size(int size);
+
+/// Run the event handler with MQTT_EVENT_CONNECTED
+void connect();
+
+/// Run the event handler with MQTT_EVENT_DISCONNECTED
+void disconnect();
+
+/// Run the event handler with MQTT_EVENT_DATA
+void deliver(std::string_view topic, std::string_view data);
+
+} // end namespace
+
+// Local Variables:
+// compile-command: "cd .. && cmake -S . -B build && cmake --build build"
+// End:
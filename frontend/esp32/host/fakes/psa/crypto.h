@@ -0,0 +1,45 @@
+#pragma once
+
+// Host stand-in for the PSA Crypto API, only the SHA-256 hash operations.
+// Backed by OpenSSL.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int32_t psa_status_t;
+typedef uint32_t psa_algorithm_t;
+
+#define PSA_SUCCESS ((psa_status_t) 0)
+#define PSA_ERROR_GENERIC_ERROR ((psa_status_t) -132)
+#define PSA_ERROR_NOT_SUPPORTED ((psa_status_t) -134)
+#define PSA_ERROR_BAD_STATE ((psa_status_t) -137)
+#define PSA_ERROR_BUFFER_TOO_SMALL ((psa_status_t) -138)
+
+#define PSA_ALG_SHA_256 ((psa_algorithm_t) 0x02000009)
+#define PSA_HASH_LENGTH(alg) ((alg) == PSA_ALG_SHA_256 ? 32u : 0u)
+
+typedef struct {
+    /// EVP_MD_CTX
+    void* ctx;
+} psa_hash_operation_t;
+
+#define PSA_HASH_OPERATION_INIT { nullptr }
+
+psa_status_t psa_crypto_init();
+
+psa_status_t psa_hash_setup(psa_hash_operation_t* operation, psa_algorithm_t alg);
+
+psa_status_t psa_hash_update(psa_hash_operation_t* operation,
+                             const uint8_t* input, size_t input_length);
+
+psa_status_t psa_hash_finish(psa_hash_operation_t* operation,
+                             uint8_t* hash, size_t hash_size, size_t* hash_length);
+
+psa_status_t psa_hash_clone(const psa_hash_operation_t* source_operation,
+                            psa_hash_operation_t* target_operation);
+
+psa_status_t psa_hash_abort(psa_hash_operation_t* operation);
+
+// Local Variables:
+// compile-command: "cd ../.. && cmake -S . -B build && cmake --build build"
+// End:
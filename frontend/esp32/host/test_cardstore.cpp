@@ -0,0 +1,110 @@
+#include "check.h"
+#include "cardstore.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+static constexpr size_t PARTITION_SIZE = 2*4096;
+
+static Card_table make_table(int nof_cards, int user_base)
+{
+    Card_table table;
+    for (int i = 0; i < nof_cards; ++i)
+        table.add(0x100000 + i*31, user_base + i, user_base + 1000 + i);
+    table.finalize();
+    return table;
+}
+
+/// True if the store holds exactly the cards of table, with the user IDs
+/// given by make_table(nof_cards, user_base)
+static bool holds(const Card_store& store, int nof_cards, int user_base)
+{
+    if (store.size() != static_cast<size_t>(nof_cards))
+        return false;
+    for (int i = 0; i < nof_cards; ++i)
+    {
+        Card_table::User_info info;
+        if (!store.find(0x100000 + i*31, info) ||
+            info.user_id != user_base + i ||
+            info.user_int_id != user_base + 1000 + i)
+            return false;
+    }
+    return true;
+}
+
+static void test_save_and_open()
+{
+    auto& store = Card_store::instance();
+    fake_partition::reset("cards", PARTITION_SIZE);
+    CHECK(!store.open());
+    CHECK(store.size() == 0);
+    CHECK(store.save(make_table(100, 1), 1000));
+    CHECK(holds(store, 100, 1));
+    CHECK(store.save(make_table(50, 2000), 2000));
+    CHECK(holds(store, 50, 2000));
+    CHECK(store.get_timestamp() == 2000);
+    // Reboot
+    CHECK(store.open());
+    CHECK(holds(store, 50, 2000));
+    CHECK(store.get_timestamp() == 2000);
+    // Too big
+    CHECK(!store.save(make_table(card_format::max_entries(PARTITION_SIZE/2) + 1, 1), 3000));
+    CHECK(holds(store, 50, 2000));
+}
+
+/// Cut the power after every possible number of bytes while saving a
+/// table. After reboot the store must hold either the previous table or
+/// the new one, never a mix.
+static void test_torn_writes()
+{
+    auto& store = Card_store::instance();
+    // Erase of the slot, entries, header
+    const long total = PARTITION_SIZE/2 + 80*Card_table::ENTRY_SIZE + sizeof(card_format::Header);
+    const long header_start = total - sizeof(card_format::Header);
+    // Failed writes are expected
+    fake_log_level = ESP_LOG_NONE;
+    for (int previous = 0; previous <= 2; ++previous)
+        for (long budget = 0; budget <= total; ++budget)
+        {
+            fake_partition::reset("cards", PARTITION_SIZE);
+            store.open();
+            // Tables already stored, so that the slot being written is
+            // erased, or holds an older table
+            if (previous >= 1)
+                store.save(make_table(100, 1), 1000);
+            if (previous >= 2)
+                store.save(make_table(120, 5000), 2000);
+            fake_partition::budget = budget;
+            const bool saved = store.save(make_table(80, 9000), 3000);
+            fake_partition::budget = -1;
+            CHECK(saved == (budget == total));
+            // Reboot
+            const bool opened = store.open();
+            const bool is_new = holds(store, 80, 9000);
+            // The new table cannot be valid before its header is written
+            if (budget < header_start)
+                CHECK(!is_new);
+            if (budget == total)
+                CHECK(is_new);
+            if (is_new)
+                continue;
+            if (previous == 0)
+                CHECK(!opened && store.size() == 0);
+            else if (previous == 1)
+                CHECK(holds(store, 100, 1));
+            else
+                CHECK(holds(store, 120, 5000));
+        }
+    fake_log_level = ESP_LOG_WARN;
+}
+
+int main()
+{
+    test_save_and_open();
+    test_torn_writes();
+    return check_result();
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ctest --test-dir build"
+// End:
@@ -0,0 +1,295 @@
+#include "check.h"
+#include "cardcache.h"
+#include "cardstore.h"
+#include "controller.h"
+#include "defs.h"
+#include "display.h"
+#include "fake_cardreader.h"
+#include "fake_hw.h"
+#include "mqtt.h"
+#include "nvs.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+using namespace std::chrono_literals;
+
+static constexpr Card_reader::Card_id ALLOWED_CARD = 0x0012345678;
+static constexpr Card_reader::Card_id UNKNOWN_CARD = 0x00DEADBEEF;
+
+static constexpr const char* BACKEND_LOG_TOPIC = "hal9k/acs/backend/log";
+static constexpr const char* SPACE_STATUS_TOPIC = "hal9k/acs/status/space";
+static constexpr const char* SLACK_TOPIC = "hal9k/acs/backend/slack";
+
+/// Thrown by a scheduled event to stop Controller::run()
+struct End_of_scenario
+{
+};
+
+/// Runs the real controller against the fakes, in virtual time. Inputs,
+/// swipes and checks are scheduled relative to the start of the scenario,
+/// and run while the controller is waiting for something to happen.
+class Scenario
+{
+public:
+    /// wall_time is the wall clock at the start
+    Scenario(const char* name, time_t wall_time)
+        : name(name),
+          start_us(esp_timer_get_time())
+    {
+        fake_hw::set_wall_time(wall_time);
+        fake_mqtt::take_published();
+    }
+
+    void at(std::chrono::milliseconds t, std::function<void()> fn)
+    {
+        fake_clock::schedule(start_us + std::chrono::microseconds(t).count(), std::move(fn));
+    }
+
+    /// Press and release a button, with some contact bounce
+    void press(std::chrono::milliseconds t, gpio_num_t pin)
+    {
+        // Buttons are active low
+        at(t, [pin] { fake_gpio::set_level(pin, 0); });
+        at(t + 1ms, [pin] { fake_gpio::set_level(pin, 1); });
+        at(t + 2ms, [pin] { fake_gpio::set_level(pin, 0); });
+        at(t + 200ms, [pin] { fake_gpio::set_level(pin, 1); });
+    }
+
+    void swipe(std::chrono::milliseconds t, Card_reader::Card_id id)
+    {
+        at(t, [id] { fake_card_reader::swipe(id); });
+    }
+
+    /// Run the controller for duration
+    void run(std::chrono::milliseconds duration)
+    {
+        at(duration, [] { throw End_of_scenario(); });
+        const int failures = check_failures;
+        Display display(tft);
+        display.start_uptime_counter();
+        Controller controller(display, Card_reader::instance());
+        try
+        {
+            controller.run();
+        }
+        catch (const End_of_scenario&)
+        {
+        }
+        if (check_failures != failures)
+            fprintf(stderr, "Scenario '%s' failed\n", name);
+        simulated_us += std::chrono::microseconds(duration).count();
+    }
+
+    /// True if a row of text on the display is exactly line
+    bool shows(const std::string& line) const
+    {
+        std::string text = "\n";
+        text += tft.get_text();
+        text += '\n';
+        return text.find('\n' + line + '\n') != std::string::npos;
+    }
+
+    /// Number of messages on topic containing data, published since the
+    /// last call
+    static int count_published(const std::string& topic, const std::string& data)
+    {
+        int n = 0;
+        for (const auto& m : fake_mqtt::take_published())
+            if (m.topic == topic && m.data.find(data) != std::string::npos)
+                ++n;
+        return n;
+    }
+
+    const char* name;
+    TFT_eSPI tft;
+    /// Total virtual time of all scenarios
+    static inline int64_t simulated_us = 0;
+
+private:
+    const int64_t start_us;
+};
+
+/// Local time, as seen by the controller
+static time_t local_time(int year, int month, int day, int hour, int minute, int second)
+{
+    struct tm t = {};
+    t.tm_year = year - 1900;
+    t.tm_mon = month - 1;
+    t.tm_mday = day;
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_sec = second;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+/// A card swiped during a timed unlock is ignored, and must not cut the
+/// unlock period short. Once locked, the same card unlocks for ENTER_TIME.
+static void test_swipe_during_timed_unlock()
+{
+    // A Wednesday
+    Scenario s("swipe during timed unlock", local_time(2026, 10, 14, 12, 0, 0));
+    s.at(500ms, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("Locked"));
+    });
+    s.press(1s, PIN_GREEN);
+    s.at(2s, [&s]
+    {
+        CHECK(fake_hw::get_relay());
+        CHECK(s.shows("Open for"));
+        CHECK(s.shows("15 minutes"));
+    });
+    s.swipe(60s, ALLOWED_CARD);
+    s.at(61s, [&s]
+    {
+        CHECK(fake_hw::get_relay());
+        CHECK(!s.shows("Valid card swiped"));
+        // The card was not looked up
+        CHECK(Scenario::count_published(BACKEND_LOG_TOPIC, "Granted entry") == 0);
+    });
+    s.at(60s + 10s, [] { CHECK(fake_hw::get_relay()); });
+    s.at(1s + 15min - 1s, [] { CHECK(fake_hw::get_relay()); });
+    // Timed out, and locked right away
+    s.at(1s + 15min + 1s, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("Locked"));
+    });
+    s.swipe(16min, ALLOWED_CARD);
+    s.at(16min + 100ms, [&s]
+    {
+        CHECK(fake_hw::get_relay());
+        CHECK(s.shows("Valid card swiped"));
+        CHECK(fake_card_reader::get_pattern() == Card_reader::Pattern::enter);
+        CHECK(Scenario::count_published(BACKEND_LOG_TOPIC, "Granted entry") == 1);
+    });
+    s.at(16min + 5s, [] { CHECK(fake_hw::get_relay()); });
+    s.at(16min + 7s, [] { CHECK(!fake_hw::get_relay()); });
+    s.swipe(17min, UNKNOWN_CARD);
+    s.at(17min + 100ms, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("Unknown card"));
+    });
+    s.run(18min);
+}
+
+/// Leave during a timed unlock restarts the timeout with LEAVE_TIME, so
+/// the door locks shortly after
+static void test_leave_during_timed_unlock()
+{
+    Scenario s("leave during timed unlock", local_time(2026, 10, 14, 14, 0, 0));
+    s.press(1s, PIN_GREEN);
+    s.at(2s, [&s]
+    {
+        CHECK(fake_hw::get_relay());
+        CHECK(s.shows("Open for"));
+        // Drop the messages published so far
+        Scenario::count_published(SLACK_TOPIC, "");
+    });
+    s.press(60s, PIN_LEAVE);
+    s.at(60s + 2s, [&s]
+    {
+        CHECK(fake_hw::get_relay());
+        CHECK(Scenario::count_published(SLACK_TOPIC, "Leave button") == 1);
+    });
+    // LEAVE_TIME is 3 s from the debounced press
+    s.at(60s + 4s, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("Locked"));
+    });
+    s.run(70s);
+}
+
+/// The space opened with White on a Thursday closes at midnight
+static void test_thursday_rollover()
+{
+    Scenario s("Thursday rollover", local_time(2026, 10, 15, 23, 58, 0));
+    s.at(1s, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("Locked"));
+    });
+    s.press(10s, PIN_WHITE);
+    s.at(11s, [&s]
+    {
+        CHECK(fake_hw::get_relay());
+        CHECK(s.shows("Open"));
+        CHECK(Scenario::count_published(SPACE_STATUS_TOPIC, "open") == 1);
+    });
+    // 23:59:59
+    s.at(119s, [] { CHECK(fake_hw::get_relay()); });
+    // 00:00:00.5 on Friday
+    s.at(120s + 500ms, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("Locked"));
+        CHECK(Scenario::count_published(SPACE_STATUS_TOPIC, "closed") == 1);
+    });
+    s.press(150s, PIN_WHITE);
+    s.at(151s, [&s]
+    {
+        CHECK(!fake_hw::get_relay());
+        CHECK(s.shows("It is not"));
+    });
+    s.run(160s);
+}
+
+int main()
+{
+    // The device runs on UTC
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    // The controller logs to stdout and MQTT
+    fake_log_level = ESP_LOG_ERROR;
+    fake_clock::set_virtual(0);
+
+    uint8_t key[SIGNING_KEY_SIZE] = { 1, 2, 3 };
+    set_identifier("main");
+    set_mqtt_address("localhost");
+    set_acs_token("token");
+    clear_wifi_credentials();
+    set_private_key(key);
+    init_nvs();
+    init_hardware();
+
+    // Permissions from an earlier boot
+    fake_partition::reset("cards", 2*4096);
+    Card_store::instance().open();
+    Card_table table;
+    table.add(ALLOWED_CARD, 42, 17);
+    table.finalize();
+    CHECK(Card_store::instance().save(table, get_wall_time()));
+    Card_cache::instance().load_stored_table();
+
+    fake_partition::reset("spill", 64*1024);
+    Mqtt::instance().start(get_mqtt_address());
+    fake_mqtt::connect();
+
+    const auto start = std::chrono::steady_clock::now();
+    test_swipe_during_timed_unlock();
+    test_leave_during_timed_unlock();
+    test_thursday_rollover();
+    const auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    printf("Simulated %d s in %d ms, %d times real time\n",
+           static_cast<int>(Scenario::simulated_us/1000000), static_cast<int>(elapsed_us/1000),
+           static_cast<int>(Scenario::simulated_us/std::max<int64_t>(1, elapsed_us)));
+    return check_result();
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ctest --test-dir build"
+// End:
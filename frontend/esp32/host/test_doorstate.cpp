@@ -0,0 +1,151 @@
+#include "check.h"
+#include "doorstate.h"
+
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <string>
+#include <tuple>
+
+using door_state::State;
+using door_state::Trigger;
+
+using Transition_set = std::set<std::tuple<State, Trigger, State>>;
+
+/// Arrow labels in states.plantuml. Several triggers are separated by
+/// "/\n", and "\n" inside a trigger is a line break.
+static const std::map<std::string, Trigger> LABELS = {
+    { "Press White on Thursday", Trigger::white_on_thursday },
+    { "Press Green",             Trigger::green },
+    { "Swipe card",              Trigger::card },
+    { "Press Leave",             Trigger::leave },
+    { "Press Red",               Trigger::red },
+    { "End of Thursday",         Trigger::end_of_thursday },
+    { "Timeout",                 Trigger::timeout },
+    { "Remote lock",             Trigger::remote_lock },
+    { "Remote unlock",           Trigger::remote_unlock },
+};
+
+static bool parse_state(const std::string& s, State& state)
+{
+    if (s == "[*]")
+    {
+        state = State::initial;
+        return true;
+    }
+    for (size_t i = 0; i < door_state::NOF_STATES; ++i)
+        if (s == door_state::STATE_NAMES[i] && i != door_state::index(State::initial))
+        {
+            state = static_cast<State>(i);
+            return true;
+        }
+    fprintf(stderr, "Unknown state '%s'\n", s.c_str());
+    return false;
+}
+
+static bool parse_trigger(const std::string& text, Trigger& trigger)
+{
+    std::string label;
+    for (size_t i = 0; i < text.size(); ++i)
+        if (text.compare(i, 2, "\\n") == 0)
+        {
+            label += ' ';
+            ++i;
+        }
+        else
+            label += text[i];
+    const auto it = LABELS.find(label);
+    if (it == LABELS.end())
+    {
+        fprintf(stderr, "Unknown trigger '%s'\n", label.c_str());
+        return false;
+    }
+    trigger = it->second;
+    return true;
+}
+
+/// Read the transitions of states.plantuml
+static Transition_set parse_diagram(const char* path)
+{
+    Transition_set result;
+    std::ifstream file(path);
+    CHECK(file.good());
+    // from -> to: label, with any number of dashes in the arrow
+    const std::regex arrow(R"(^\s*(\S+)\s+-+>\s+(\S+)\s*(?::\s*(.*\S))?\s*$)");
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::smatch m;
+        if (!std::regex_match(line, m, arrow))
+            continue;
+        State from, to;
+        CHECK(parse_state(m[1], from));
+        CHECK(parse_state(m[2], to));
+        const std::string label = m[3];
+        if (label.empty())
+        {
+            // Only the initial transition has no trigger
+            CHECK(from == State::initial);
+            CHECK(result.emplace(from, Trigger::start, to).second);
+            continue;
+        }
+        size_t start = 0;
+        for (;;)
+        {
+            const auto end = label.find("/\\n", start);
+            Trigger trigger;
+            if (parse_trigger(label.substr(start, end - start), trigger))
+            {
+                const bool added = result.emplace(from, trigger, to).second;
+                if (!added)
+                    fprintf(stderr, "Duplicate: %s\n", line.c_str());
+                CHECK(added);
+            }
+            else
+                CHECK(false);
+            if (end == std::string::npos)
+                break;
+            start = end + 3;
+        }
+    }
+    return result;
+}
+
+static void print(const char* what, const Transition_set::value_type& t)
+{
+    fprintf(stderr, "%s: %s -> %s on %s\n", what,
+            door_state::name(std::get<0>(t)), door_state::name(std::get<2>(t)),
+            door_state::name(std::get<1>(t)));
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: test_doorstate states.plantuml\n");
+        return 1;
+    }
+    const auto diagram = parse_diagram(argv[1]);
+    Transition_set table;
+    for (const auto& t : door_state::TRANSITIONS)
+        table.emplace(t.from, t.trigger, t.to);
+    CHECK(!diagram.empty());
+    for (const auto& t : diagram)
+        if (!table.count(t))
+        {
+            print("Only in diagram", t);
+            CHECK(false);
+        }
+    for (const auto& t : table)
+        if (!diagram.count(t))
+        {
+            print("Only in TRANSITIONS", t);
+            CHECK(false);
+        }
+    return check_result();
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ctest --test-dir build"
+// End:
@@ -0,0 +1,171 @@
+#include "check.h"
+#include "permparser.h"
+
+#include <random>
+#include <string.h>
+#include <string>
+
+struct Parse_result
+{
+    Card_table table;
+    bool ok = false;
+    bool complete = false;
+    int nof_bad_items = 0;
+};
+
+/// Feed json to a parser in pieces of chunk_size bytes, or in random
+/// pieces if rng is given
+static Parse_result parse(const std::string& json, size_t chunk_size,
+                          std::mt19937* rng = nullptr)
+{
+    Parse_result result;
+    Permissions_parser parser(result.table);
+    result.ok = true;
+    for (size_t pos = 0; pos < json.size(); )
+    {
+        size_t n = chunk_size;
+        if (rng)
+            n = std::uniform_int_distribution<size_t>(1, 64)(*rng);
+        n = std::min(n, json.size() - pos);
+        result.ok = parser.add(json.data() + pos, n) && result.ok;
+        pos += n;
+    }
+    result.table.finalize();
+    result.complete = parser.is_complete();
+    result.nof_bad_items = parser.get_nof_bad_items();
+    return result;
+}
+
+static bool same(const Parse_result& a, const Parse_result& b)
+{
+    return a.ok == b.ok && a.complete == b.complete &&
+        a.nof_bad_items == b.nof_bad_items &&
+        a.table.size() == b.table.size() &&
+        (a.table.size() == 0 ||
+         !memcmp(a.table.data(), b.table.data(), a.table.size()*Card_table::ENTRY_SIZE));
+}
+
+static bool has(const Card_table& table, Card_table::Card_id id, int user_id, int user_int_id)
+{
+    Card_table::User_info info;
+    return table.find(id, info) && info.user_id == user_id && info.user_int_id == user_int_id;
+}
+
+static const std::string SAMPLE =
+    "[\n"
+    "  {\"card_id\": \"00000A1B2C\", \"id\": 42, \"int_id\": 17, \"name\": \"A \\\"quoted\\\" name\"},\n"
+    "  {\"id\": 43, \"int_id\": 18, \"card_id\": \"FFFFFFFFFF\", \"roles\": [1, {\"x\": [2, 3]}, \"y\"]},\n"
+    "  {\"card_id\": \"0000000001\", \"id\": 44, \"int_id\": -1, \"active\": true, \"note\": null}\n"
+    "]\n";
+
+static void test_sample()
+{
+    const auto r = parse(SAMPLE, SAMPLE.size());
+    CHECK(r.ok);
+    CHECK(r.complete);
+    CHECK(r.nof_bad_items == 0);
+    CHECK(r.table.size() == 3);
+    CHECK(has(r.table, 0x00000A1B2C, 42, 17));
+    CHECK(has(r.table, 0xFFFFFFFFFF, 43, 18));
+    CHECK(has(r.table, 1, 44, -1));
+}
+
+static void test_chunking()
+{
+    // The result must not depend on how the data is split up
+    const auto whole = parse(SAMPLE, SAMPLE.size());
+    for (size_t chunk_size = 1; chunk_size < SAMPLE.size(); ++chunk_size)
+        CHECK(same(parse(SAMPLE, chunk_size), whole));
+}
+
+static void test_bad_items()
+{
+    const auto r = parse("[{\"card_id\": \"0000000002\", \"id\": 1},"
+                         " {\"card_id\": \"XYZ\", \"id\": 2, \"int_id\": 3},"
+                         " {\"card_id\": \"0000000003\", \"id\": 1.5, \"int_id\": 3},"
+                         " \"string\", 17,"
+                         " {\"card_id\": \"0000000004\", \"id\": 4, \"int_id\": 5}]", 1);
+    CHECK(r.ok);
+    CHECK(r.complete);
+    CHECK(r.nof_bad_items == 5);
+    CHECK(r.table.size() == 1);
+    CHECK(has(r.table, 4, 4, 5));
+}
+
+static void test_nested_array()
+{
+    // An array inside the top level array is skipped as a bad item,
+    // including any scalars and objects inside it
+    const auto r = parse("[[1, \"a\", {\"card_id\": \"0000000005\", \"id\": 5, \"int_id\": 5}, [[]]],"
+                         " {\"card_id\": \"0000000006\", \"id\": 6, \"int_id\": 7}]", 1);
+    CHECK(r.ok);
+    CHECK(r.complete);
+    CHECK(r.nof_bad_items == 1);
+    CHECK(r.table.size() == 1);
+    CHECK(has(r.table, 6, 6, 7));
+}
+
+static void test_errors()
+{
+    CHECK(!parse("{\"card_id\": \"0000000001\"}", 1).ok);
+    CHECK(!parse("[{\"id\": 1}] x", 1).ok);
+    CHECK(!parse("[{\"id\": 1}]]", 1).ok);
+    CHECK(!parse("[] \"x", 1).ok);
+    CHECK(!parse("[{}", 1).complete);
+    CHECK(!parse("", 1).complete);
+    CHECK(!parse("[#]", 1).ok);
+}
+
+static void test_fuzz()
+{
+    // Corrupt the sample at random. The parser must neither crash nor
+    // read out of bounds (run with sanitizers), and the result must still
+    // not depend on chunking.
+    std::mt19937 rng(1234);
+    const char alphabet[] = "[]{}:,\"\\ 0aZ-.\n";
+    for (int i = 0; i < 20000; ++i)
+    {
+        std::string json = SAMPLE;
+        const int nof_edits = std::uniform_int_distribution<int>(1, 8)(rng);
+        for (int e = 0; e < nof_edits && !json.empty(); ++e)
+        {
+            const auto pos = std::uniform_int_distribution<size_t>(0, json.size() - 1)(rng);
+            const char c = alphabet[std::uniform_int_distribution<size_t>(0, sizeof(alphabet) - 2)(rng)];
+            switch (std::uniform_int_distribution<int>(0, 3)(rng))
+            {
+            case 0:
+                json[pos] = c;
+                break;
+            case 1:
+                json.insert(json.begin() + pos, c);
+                break;
+            case 2:
+                json.erase(pos, 1);
+                break;
+            case 3:
+                json.resize(pos);
+                break;
+            }
+        }
+        const auto whole = parse(json, json.size());
+        CHECK(same(parse(json, 1), whole));
+        CHECK(same(parse(json, 0, &rng), whole));
+        if (whole.complete)
+            CHECK(whole.ok);
+    }
+}
+
+int main()
+{
+    test_sample();
+    test_chunking();
+    test_bad_items();
+    test_nested_array();
+    test_errors();
+    test_fuzz();
+    return check_result();
+}
+
+// Local Variables:
+// compile-command: "cmake -S . -B build && cmake --build build && ctest --test-dir build"
+// End:
@@ -1,22 +1,32 @@
 #include "cardcache.h"
 
+#include "cardstore.h"
 #include "defs.h"
 #include "format.h"
 #include "http.h"
 #include "mqtt.h"
 #include "nvs.h"
+#include "permparser.h"
 #include "util.h"
 
 #include <memory>
 
-#include "cJSON.h"
+#include <strings.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static constexpr const char* TAG = "cc";
+static constexpr auto LOG_MODULE = Log_module::Card_cache;
 
 constexpr util::duration MAX_CACHE_AGE = std::chrono::minutes(15);
 
+// Unchanged permissions only cost a 304 reply, so we can poll often
+constexpr int REFRESH_INTERVAL_MS = 60*1000;
+
+// At most one refresh caused by unknown cards in this interval
+constexpr int64_t MIN_MISS_REFRESH_INTERVAL_US = 10*1000*1000;
+
 Card_cache& Card_cache::instance()
 {
     static Card_cache the_instance;
@@ -28,33 +38,75 @@ void Card_cache::set_api_token(const std::string& token)
     api_token = token;
 }
 
+void Card_cache::load_stored_table()
+{
+    if (!Card_store::instance().open())
+        return;
+    last_refresh = Card_store::instance().get_timestamp();
+    ESP_LOGI(TAG, "Stored table: %d cards", static_cast<int>(Card_store::instance().size()));
+}
+
+bool Card_cache::find(Card_id id, Card_table::User_info& ui)
+{
+    // publish() will not free the snapshot while active_readers > 0
+    ++active_readers;
+    const auto snapshot = cache.load();
+    bool found;
+    if (snapshot)
+        found = snapshot->find(id, ui);
+    else
+        // Nothing fetched yet, use last good table
+        found = Card_store::instance().find(id, ui);
+    --active_readers;
+    return found;
+}
+
 Card_cache::Result Card_cache::has_access(Card_cache::Card_id id)
 {
-    User_info ui;
-    bool found = false;
+    Card_table::User_info ui;
+    if (find(id, ui))
     {
-        std::lock_guard<std::mutex> g(cache_mutex);
-        const auto it = cache.find(id);
-        if (it != cache.end())
-        {
-            found = true;
-            ui = it->second;
-        }
-    }
-    if (found)
-    {
-        Mqtt::instance().log(format(CARD_ID_FORMAT " cached", id));
-        if (util::now() - ui.last_update > MAX_CACHE_AGE)
-            Mqtt::instance().log(format(CARD_ID_FORMAT ": stale", id));
+        MQTT_LOGD(LOG_MODULE, CARD_ID_FORMAT " cached", id);
+        if (util::now() - std::chrono::system_clock::from_time_t(last_refresh) > MAX_CACHE_AGE)
+            MQTT_LOGI(LOG_MODULE, CARD_ID_FORMAT ": stale", id);
         Mqtt::instance().log_backend(ui.user_id,
                                      format("%s: Granted entry",
                                             get_identifier().c_str()));
         return Result(Access::Allowed, ui.user_int_id);
     }
 
+    // Maybe the card was just added
+    refresh_on_miss();
     return Result(Access::Unknown, -1, "");
 }
 
+struct Permissions_request
+{
+    Permissions_parser parser;
+    /// ETag from response headers
+    std::string etag;
+};
+
+// Feeds the response body to the parser in the Permissions_request in user_data
+static esp_err_t permissions_event_handler(esp_http_client_event_t* evt)
+{
+    auto request = reinterpret_cast<Permissions_request*>(evt->user_data);
+    switch (evt->event_id)
+    {
+    case HTTP_EVENT_ON_HEADER:
+        if (!strcasecmp(evt->header_key, "ETag"))
+            request->etag = evt->header_value;
+        return ESP_OK;
+
+    case HTTP_EVENT_ON_DATA:
+        request->parser.add(reinterpret_cast<const char*>(evt->data), evt->data_len);
+        return ESP_OK;
+
+    default:
+        return http_event_handler(evt);
+    }
+}
+
 Card_cache::Card_id Card_cache::get_id_from_string(const std::string& s)
 {
     std::istringstream is(s);
@@ -65,6 +117,7 @@ Card_cache::Card_id Card_cache::get_id_from_string(const std::string& s)
 
 void Card_cache::thread_body()
 {
+    task = xTaskGetCurrentTaskHandle();
     bool first = true;
     while (1)
     {
@@ -75,115 +128,159 @@ void Card_cache::thread_body()
             continue;
         }
         if (!first)
-            vTaskDelay(5*60*1000 / portTICK_PERIOD_MS);
+            // Woken early by refresh_on_miss()
+            ulTaskNotifyTake(pdTRUE, REFRESH_INTERVAL_MS / portTICK_PERIOD_MS);
         first = false;
-        ESP_LOGI(TAG, "Update");
-
-        // Fetch card info
-        constexpr int HTTP_MAX_OUTPUT = 10*1024;
-        auto buffer = std::unique_ptr<char[]>(new (std::nothrow) char[HTTP_MAX_OUTPUT+1]);
-        if (!buffer)
-        {
-            ESP_LOGE(TAG, "Could not allocate %d bytes", HTTP_MAX_OUTPUT+1);
-            continue;
-        }
-        Http_data http_data;
-        http_data.buffer = buffer.get();
-        http_data.max_output = HTTP_MAX_OUTPUT;
-        esp_http_client_config_t config {
-            .host = "panopticon.hal9k.dk",
-            .path = "/api/v2/permissions/",
-            .event_handler = http_event_handler,
-            .transport_type = HTTP_TRANSPORT_OVER_SSL,
-            .user_data = &http_data,
-            .crt_bundle_attach = esp_crt_bundle_attach,
-        };
-        esp_http_client_handle_t client = esp_http_client_init(&config);
-        Http_client_wrapper w(client);
-
-        ESP_ERROR_CHECK(esp_http_client_set_method(client, HTTP_METHOD_GET));
-
-        const char* content_type = "application/json";
-        ESP_ERROR_CHECK(esp_http_client_set_header(client, "Accept", content_type));
-        ESP_ERROR_CHECK(esp_http_client_set_header(client, "Content-Type", content_type));
-        const std::string auth = std::string("Token ") + std::string(api_token);
-        ESP_ERROR_CHECK(esp_http_client_set_header(client, "Authorization", auth.c_str()));
-        esp_err_t err = esp_http_client_perform(client);
-        if (err != ESP_OK)
+        int64_t miss_time = 0;
         {
-            ESP_LOGE(TAG, "/v2/permissions: error %s", esp_err_to_name(err));
-            ESP_LOGI(TAG, "Memory %zu", heap_caps_get_free_size(MALLOC_CAP_8BIT));
-            continue;
-        }
-        const auto code = esp_http_client_get_status_code(client);
-        if (code != 200)
-        {
-            ESP_LOGE(TAG, "Error: Unexpected response from /v2/permissions: %d", code);
-            Mqtt::instance().log(format("Error: Unexpected response from /v2/permissions: %d", code));
-            continue;
+            std::lock_guard<std::mutex> g(miss_mutex);
+            if (refresh_pending)
+                miss_time = last_miss_refresh;
         }
-        Mqtt::instance().log(format("/v2/permissions: %d bytes", strlen(buffer.get())));
-        auto root = cJSON_Parse(buffer.get());
-        cJSON_wrapper jw(root);
-        if (!root)
-        {
-            ESP_LOGE(TAG, "Error: Bad JSON from /v2/permissions: %s", buffer.get());
-            Mqtt::instance().log(format("Error: Bad JSON from /v2/permissions"));
-            continue;
-        }
-        if (!cJSON_IsArray(root))
-        {
-            ESP_LOGE(TAG, "Error: Response from /v2/permissions is not an array");
-            Mqtt::instance().log("Error: Response from /v2/permissions is not an array");
-            continue;
-        }
-        // Create new cache
-        Cache new_cache;
-        cJSON* it;
-        cJSON_ArrayForEach(it, root)
+        ESP_LOGI(TAG, "Update%s", miss_time ? " (miss)" : "");
+
+        const bool ok = update();
+
+        if (miss_time)
         {
-            if (!cJSON_IsObject(it))
+            const int latency_ms = (esp_timer_get_time() - miss_time)/1000;
+            Miss_stats s;
             {
-                ESP_LOGE(TAG, "Error: Item from /v2/permissions is not an object");
-                Mqtt::instance().log("Error: Item from /v2/permissions is not an object");
-                continue;
+                std::lock_guard<std::mutex> g(miss_mutex);
+                refresh_pending = false;
+                ++miss_stats.refreshes;
+                miss_stats.last_latency_ms = latency_ms;
+                miss_stats.max_latency_ms = std::max(miss_stats.max_latency_ms, latency_ms);
+                s = miss_stats;
             }
-            auto card_id_node = cJSON_GetObjectItem(it, "card_id");
-            if (!cJSON_IsString(card_id_node))
-            {
-                ESP_LOGE(TAG, "Error: Item from /v2/permissions has no card_id");
-                Mqtt::instance().log("Error: Item from /v2/permissions has no card_id");
-                continue;
-            }
-            auto id_node = cJSON_GetObjectItem(it, "id");
-            if (!cJSON_IsNumber(id_node))
-            {
-                ESP_LOGE(TAG, "Error: Item from /v2/permissions has no id");
-                Mqtt::instance().log("Error: Item from /v2/permissions has no id");
-                continue;
-            }
-            auto int_id_node = cJSON_GetObjectItem(it, "int_id");
-            if (!cJSON_IsNumber(int_id_node))
-            {
-                ESP_LOGE(TAG, "Error: Item from /v2/permissions has no int_id");
-                Mqtt::instance().log("Error: Item from /v2/permissions has no int_id");
-                continue;
-            }
-            const auto card_id = get_id_from_string(card_id_node->valuestring);
-            const auto id = id_node->valueint;
-            const auto int_id = int_id_node->valueint;
-            new_cache[card_id] = { id, int_id, util::now() };
+            MQTT_LOGI(LOG_MODULE, "Miss refresh %s in %d ms (misses %d coalesced %d rate limited %d refreshes %d max %d ms)",
+                      ok ? "done" : "failed", latency_ms,
+                      s.misses, s.coalesced, s.rate_limited, s.refreshes, s.max_latency_ms);
         }
-        // Store
-        const auto size = new_cache.size();
-        {
-            std::lock_guard<std::mutex> g(cache_mutex);
-            cache.swap(new_cache);
-        }
-        Mqtt::instance().log(format("Card cache updated: %d cards", static_cast<int>(size)));
     }
 }
 
+void Card_cache::refresh_on_miss()
+{
+    std::lock_guard<std::mutex> g(miss_mutex);
+    ++miss_stats.misses;
+    if (refresh_pending)
+    {
+        // Already on its way
+        ++miss_stats.coalesced;
+        return;
+    }
+    const auto now = esp_timer_get_time();
+    if (last_miss_refresh && now - last_miss_refresh < MIN_MISS_REFRESH_INTERVAL_US)
+    {
+        ++miss_stats.rate_limited;
+        return;
+    }
+    if (!task)
+        return;
+    last_miss_refresh = now;
+    refresh_pending = true;
+    xTaskNotifyGive(task);
+}
+
+Card_cache::Miss_stats Card_cache::get_miss_stats()
+{
+    std::lock_guard<std::mutex> g(miss_mutex);
+    return miss_stats;
+}
+
+bool Card_cache::update()
+{
+    // Fetch card info. The response is parsed as it arrives.
+    auto new_cache = std::make_unique<Cache>();
+    {
+        // Only this task replaces the snapshot, so it is safe to read here
+        const auto current = cache.load();
+        if (current)
+            new_cache->reserve(current->size());
+    }
+    Permissions_request request{ Permissions_parser(*new_cache) };
+    auto& parser = request.parser;
+    esp_http_client_config_t config {
+        .host = "panopticon.hal9k.dk",
+        .path = "/api/v2/permissions/",
+        .event_handler = permissions_event_handler,
+        .transport_type = HTTP_TRANSPORT_OVER_SSL,
+        .user_data = &request,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    Http_client_wrapper w(client);
+
+    ESP_ERROR_CHECK(esp_http_client_set_method(client, HTTP_METHOD_GET));
+
+    const char* content_type = "application/json";
+    ESP_ERROR_CHECK(esp_http_client_set_header(client, "Accept", content_type));
+    ESP_ERROR_CHECK(esp_http_client_set_header(client, "Content-Type", content_type));
+    const std::string auth = std::string("Token ") + std::string(api_token);
+    ESP_ERROR_CHECK(esp_http_client_set_header(client, "Authorization", auth.c_str()));
+    if (!etag.empty() && cache.load())
+        // Server replies 304 if nothing has changed
+        ESP_ERROR_CHECK(esp_http_client_set_header(client, "If-None-Match", etag.c_str()));
+    esp_err_t err = esp_http_client_perform(client);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "/v2/permissions: error %s", esp_err_to_name(err));
+        ESP_LOGI(TAG, "Memory %zu", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        return false;
+    }
+    const auto code = esp_http_client_get_status_code(client);
+    if (code == 304)
+    {
+        time_t now;
+        time(&now);
+        last_refresh = now;
+        MQTT_LOGD(LOG_MODULE, "Card cache unchanged");
+        return true;
+    }
+    if (code != 200)
+    {
+        ESP_LOGE(TAG, "Error: Unexpected response from /v2/permissions: %d", code);
+        MQTT_LOGE(LOG_MODULE, "Error: Unexpected response from /v2/permissions: %d", code);
+        return false;
+    }
+    MQTT_LOGD(LOG_MODULE, "/v2/permissions: %d bytes", static_cast<int>(parser.get_nof_bytes()));
+    if (!parser.is_complete())
+    {
+        ESP_LOGE(TAG, "Error: Bad JSON from /v2/permissions");
+        MQTT_LOGE(LOG_MODULE, "Error: Bad JSON from /v2/permissions");
+        return false;
+    }
+    if (parser.get_nof_bad_items())
+    {
+        ESP_LOGE(TAG, "Error: %d bad items from /v2/permissions", parser.get_nof_bad_items());
+        MQTT_LOGE(LOG_MODULE, "Error: %d bad items from /v2/permissions", parser.get_nof_bad_items());
+    }
+    new_cache->finalize();
+    new_cache->set_last_update(util::now());
+    const auto now = std::chrono::system_clock::to_time_t(util::now());
+    // Keep a copy in flash for next boot
+    Card_store::instance().save(*new_cache, now);
+    // Store
+    const auto size = new_cache->size();
+    const auto heap_bytes = new_cache->heap_bytes();
+    publish(new_cache.release());
+    etag = request.etag;
+    last_refresh = now;
+    MQTT_LOGI(LOG_MODULE, "Card cache updated: %d cards, %d bytes",
+              static_cast<int>(size), static_cast<int>(heap_bytes));
+    return true;
+}
+
+void Card_cache::publish(const Cache* new_cache)
+{
+    const auto old_cache = cache.exchange(new_cache);
+    // Grace period: a reader may still be using the old snapshot
+    while (active_readers.load() > 0)
+        vTaskDelay(1);
+    delete old_cache;
+}
+
 void card_cache_task(void*)
 {
     Card_cache::instance().thread_body();
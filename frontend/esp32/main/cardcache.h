@@ -3,12 +3,13 @@
 #include "util.h"
 
 #include <RDM6300.h>
+#include <cardtable.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "esp_http_client.h"
 
-#include <map>
+#include <atomic>
 #include <mutex>
 
 extern "C" void card_cache_task(void*);
@@ -40,26 +41,70 @@ public:
 
     void set_api_token(const std::string& token);
 
+    /// Use table stored in flash until a fresh one has been fetched
+    void load_stored_table();
+
     Result has_access(Card_id id);
 
+    struct Miss_stats
+    {
+        /// Lookups of unknown cards
+        int misses = 0;
+        /// Misses while a refresh was already pending
+        int coalesced = 0;
+        /// Misses that did not cause a refresh due to rate limiting
+        int rate_limited = 0;
+        /// Refreshes caused by misses
+        int refreshes = 0;
+        int last_latency_ms = 0;
+        int max_latency_ms = 0;
+    };
+
+    Miss_stats get_miss_stats();
+
 private:
     Card_cache() = default;
 
     /// Updates cache in background
     void thread_body();
 
-    struct User_info
-    {
-        int user_id = 0;
-        int user_int_id = 0;
-        util::time_point last_update;
-    };
-    using Cache = std::map<Card_id, User_info>;
-    Cache cache;
-    std::mutex cache_mutex;
+    /// Fetch permissions and publish new snapshot
+    bool update();
+
+    /// Look up id in the current snapshot, or in the stored table if
+    /// nothing has been fetched yet
+    bool find(Card_id id, Card_table::User_info& ui);
+
+    /// Wake up thread_body() to fetch permissions now (rate limited)
+    void refresh_on_miss();
+
+    using Cache = Card_table;
+
+    /// Replace the current snapshot, and free the old one once no
+    /// reader is using it any more.
+    void publish(const Cache* new_cache);
+
+    /// Current snapshot. Never modified once published, so has_access()
+    /// can read it without locking.
+    std::atomic<const Cache*> cache = nullptr;
+    /// Number of has_access() calls currently reading a snapshot
+    std::atomic<int> active_readers = 0;
+    /// Time when the snapshot was last confirmed up to date
+    std::atomic<time_t> last_refresh = 0;
+    /// ETag of the current snapshot (only used by the refresh task)
+    std::string etag;
     std::string api_token;
+    /// Refresh task
+    TaskHandle_t task = nullptr;
+    std::mutex miss_mutex;
+    bool refresh_pending = false;
+    /// esp_timer_get_time() of last refresh caused by a miss
+    int64_t last_miss_refresh = 0;
+    Miss_stats miss_stats;
 
     friend void card_cache_task(void*);
+    /// Host benchmarks call update() and find() directly
+    friend struct Card_cache_bench;
 };
 
 // Local Variables:
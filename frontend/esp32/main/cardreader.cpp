@@ -15,10 +15,17 @@
 #include "esp_log.h"
 
 static constexpr const char* TAG = "card";
+static constexpr auto LOG_MODULE = Log_module::Card_reader;
 
 constexpr auto SOUND_WARNING_BEEP = "S1000 100\n";
 constexpr auto BEEP_INTERVAL = std::chrono::milliseconds(500);
 constexpr auto REOPEN_INTERVAL = std::chrono::hours(1);
+// Polling interval for readers without push mode
+constexpr int POLL_INTERVAL_MS = 500;
+// In push mode we still poll occasionally, to keep the heartbeat going
+constexpr auto HEARTBEAT_INTERVAL = std::chrono::seconds(2);
+// Re-enable push mode this often, in case the reader was reset
+constexpr auto PUSH_MODE_REFRESH_INTERVAL = std::chrono::minutes(1);
 
 Card_reader& Card_reader::instance()
 {
@@ -44,43 +51,126 @@ Card_cache::Card_id Card_reader::get_and_clear_card_id()
     return id;
 }
 
+void Card_reader::set_card_id(Card_id id)
+{
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        card_id = id;
+    }
+    Controller::notify(Controller::EVENT_CARD);
+}
+
+bool Card_reader::enable_push_mode()
+{
+    // Discard anything pending
+    char buf[40];
+    while (read_rs485(buf, sizeof(buf)) > 0)
+        ;
+    write_rs485("V\n", 2);
+    std::string reply;
+    // Each read waits for up to 100 ms
+    for (int i = 0; i < 10 && reply.find('\n') == std::string::npos; ++i)
+    {
+        const int nof_bytes = read_rs485(buf, sizeof(buf));
+        if (nof_bytes > 0)
+            reply.append(buf, nof_bytes);
+    }
+    // Older readers do not advertise +push, and are polled
+    if (reply.find("+push") == std::string::npos)
+        return false;
+    write_rs485("M1\n", 3);
+    return true;
+}
+
+// Push frame: N<10 hex digits><2 hex digits XOR checksum of the ID bytes>
+// Poll reply: ID<10 hex digits>, or just ID if there is no card
+void Card_reader::handle_line(const std::string& raw_line)
+{
+    const auto line = util::strip_np(raw_line);
+#ifdef DETAILED_DEBUG
+    if (!line.empty())
+        ESP_LOGI(TAG, "Got '%s'", line.c_str());
+#endif
+    if ((line.size() == 2+10) && (line.substr(0, 2) == std::string("ID")))
+    {
+        const auto id_str = line.substr(2);
+        MQTT_LOGD(LOG_MODULE, "Card_reader: got card ID '%s'", id_str.c_str());
+        const auto new_card_id = Card_cache::get_id_from_string(id_str);
+        if (new_card_id)
+            set_card_id(new_card_id);
+    }
+    else if ((line.size() == 1+10+2) && (line[0] == 'N'))
+    {
+        const auto new_card_id = Card_cache::get_id_from_string(line.substr(1, 10));
+        const auto checksum = Card_cache::get_id_from_string(line.substr(1+10));
+        int cs = 0;
+        for (int i = 0; i < RDM6300::ID_SIZE; ++i)
+            cs ^= (new_card_id >> (8*i)) & 0xFF;
+        if (!new_card_id || cs != checksum)
+        {
+            // Reader will resend
+            ESP_LOGE(TAG, "Bad push frame '%s'", line.c_str());
+            return;
+        }
+        write_rs485("A\n", 2);
+        MQTT_LOGD(LOG_MODULE, "Card_reader: got pushed card ID " CARD_ID_FORMAT, new_card_id);
+        set_card_id(new_card_id);
+    }
+}
+
 void Card_reader::thread_body()
 {
     util::time_point last_sound_change = util::now();
+    util::time_point last_poll = util::invalid_time_point();
+    util::time_point last_push_mode_refresh = util::now();
     Pattern last_pattern = Pattern::none;
+    push_mode = enable_push_mode();
+    MQTT_LOGI(LOG_MODULE, "Card_reader: push mode %s", push_mode ? "on" : "off");
+    std::string line;
     while (1)
     {
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+        if (!push_mode)
+            vTaskDelay(POLL_INTERVAL_MS / portTICK_PERIOD_MS);
+        else if (util::now() - last_push_mode_refresh >= PUSH_MODE_REFRESH_INTERVAL)
+        {
+            write_rs485("M1\n", 3);
+            last_push_mode_refresh = util::now();
+        }
 
+        if (!push_mode || !util::is_valid(last_poll) ||
+            util::now() - last_poll >= HEARTBEAT_INTERVAL)
+        {
 #ifdef DETAILED_DEBUG
-        ESP_LOGI(TAG, "Sending 'C'");
+            ESP_LOGI(TAG, "Sending 'C'");
 #endif
-        write_rs485("C\n", 2);
-        vTaskDelay(5 / portTICK_PERIOD_MS);
+            write_rs485("C\n", 2);
+            last_poll = util::now();
+            vTaskDelay(5 / portTICK_PERIOD_MS);
+        }
 
+        // In push mode this waits for up to PACKET_READ_TICS for data
         char buf[40];
-        const int nof_bytes = read_rs485(buf, sizeof(buf) - 1);
-        buf[nof_bytes] = 0;
-        std::string line(buf);
-        line = util::strip_np(line);
-#ifdef DETAILED_DEBUG
-        if (!line.empty())
-            ESP_LOGI(TAG, "Got '%s'", line.c_str());
-#endif
-        if (nof_bytes && Controller::exists())
+        const int nof_bytes = read_rs485(buf, sizeof(buf));
+        if (nof_bytes > 0 && Controller::exists())
         {
             Controller::instance().card_reader_heartbeat();
         }
-        if ((line.size() == 2+10) && (line.substr(0, 2) == std::string("ID")))
+        for (int i = 0; i < nof_bytes; ++i)
         {
-            line = line.substr(2);
-            Mqtt::instance().log(format("Card_reader: got card ID '%s'", line.c_str()));
-            const auto new_card_id = Card_cache::get_id_from_string(line);
-            if (new_card_id)
+            if (buf[i] == '\n')
             {
-                std::lock_guard<std::mutex> g(mutex);
-                card_id = new_card_id;
+                handle_line(line);
+                line.clear();
             }
+            else if (line.size() < sizeof(buf))
+                line += buf[i];
+        }
+        if (!push_mode)
+        {
+            // Replies without a newline are handled as before
+            if (!line.empty())
+                handle_line(line);
+            line.clear();
         }
         switch (sound)
         {
@@ -139,9 +229,7 @@ void Card_reader::thread_body()
             if (!cmd.empty())
             {
                 write_rs485(cmd.c_str(), cmd.size());
-#ifdef DETAILED_DEBUG
-                Mqtt::instance().log(format("Card_reader wrote %s", cmd.c_str()));
-#endif
+                MQTT_LOGV(LOG_MODULE, "Card_reader wrote %s", cmd.c_str());
             }
         }
     }
@@ -45,11 +45,20 @@ private:
     ~Card_reader() = default;
     
     void thread_body();
+
+    /// Check whether reader supports push mode, and enable it if so
+    bool enable_push_mode();
+
+    /// Handle a complete line received from the reader
+    void handle_line(const std::string& line);
+
+    void set_card_id(Card_id id);
     
     std::mutex mutex;
     Card_id card_id = 0;
     std::atomic<Sound> sound = Sound::none;
     std::atomic<Pattern> pattern = Pattern::none;
+    bool push_mode = false;
 
     friend void card_reader_task(void*);
 };
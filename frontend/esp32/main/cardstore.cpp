@@ -0,0 +1,114 @@
+#include "cardstore.h"
+
+#include "esp_log.h"
+
+static constexpr const char* TAG = "cstore";
+
+static constexpr auto PARTITION_SUBTYPE = static_cast<esp_partition_subtype_t>(0x40);
+
+Card_store& Card_store::instance()
+{
+    static Card_store the_instance;
+    return the_instance;
+}
+
+bool Card_store::open()
+{
+    active = -1;
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, PARTITION_SUBTYPE, "cards");
+    if (!partition)
+    {
+        ESP_LOGE(TAG, "No cards partition");
+        return false;
+    }
+    const void* ptr = nullptr;
+    const auto err = esp_partition_mmap(partition, 0, partition->size,
+                                        ESP_PARTITION_MMAP_DATA, &ptr, &mmap_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "mmap failed: %s", esp_err_to_name(err));
+        partition = nullptr;
+        return false;
+    }
+    mapped = reinterpret_cast<const uint8_t*>(ptr);
+    slot_size = partition->size/2;
+    for (int i = 0; i < 2; ++i)
+        slots[i].entries = card_format::entries(mapped + i*slot_size);
+    card_format::Header header;
+    const int newest = card_format::newest_slot(mapped, slot_size, header);
+    if (newest < 0)
+    {
+        ESP_LOGI(TAG, "No stored table");
+        return false;
+    }
+    slots[newest].header = header;
+    active = newest;
+    ESP_LOGI(TAG, "Slot %d: %d cards", newest, static_cast<int>(header.count));
+    return true;
+}
+
+bool Card_store::find(Card_id id, Card_table::User_info& info) const
+{
+    const int index = active;
+    if (index < 0)
+        return false;
+    const auto& slot = slots[index];
+    return Card_table::find(slot.entries, slot.header.count, id, info);
+}
+
+size_t Card_store::size() const
+{
+    const int index = active;
+    return index < 0 ? 0 : slots[index].header.count;
+}
+
+time_t Card_store::get_timestamp() const
+{
+    const int index = active;
+    return index < 0 ? 0 : slots[index].header.timestamp;
+}
+
+bool Card_store::save(const Card_table& table, time_t timestamp)
+{
+    if (!partition)
+        return false;
+    if (table.size() > card_format::max_entries(slot_size))
+    {
+        ESP_LOGE(TAG, "Too many cards: %d", static_cast<int>(table.size()));
+        return false;
+    }
+    const int current = active;
+    uint32_t sequence = 0;
+    if (current >= 0)
+    {
+        const auto& header = slots[current].header;
+        if (header.count == table.size() &&
+            header.entries_crc == card_format::crc32(table.data(), table.size()*Card_table::ENTRY_SIZE))
+            // No change, spare the flash
+            return true;
+        sequence = header.sequence + 1;
+    }
+    // Write to the slot not in use. Entries first, header last.
+    const int target = current == 0 ? 1 : 0;
+    const size_t offset = target*slot_size;
+    const auto header = card_format::make_header(table, sequence, timestamp);
+    auto err = esp_partition_erase_range(partition, offset, slot_size);
+    if (err == ESP_OK)
+        err = esp_partition_write(partition, offset + sizeof(header), table.data(),
+                                  table.size()*Card_table::ENTRY_SIZE);
+    if (err == ESP_OK)
+        err = esp_partition_write(partition, offset, &header, sizeof(header));
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    slots[target].header = header;
+    active = target;
+    ESP_LOGI(TAG, "Saved %d cards in slot %d", static_cast<int>(header.count), target);
+    return true;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cardformat.h>
+
+#include <atomic>
+
+#include "esp_partition.h"
+
+/// Last good card table, stored in the 'cards' flash partition.
+/// Lookups search the memory mapped partition in place.
+class Card_store
+{
+public:
+    using Card_id = Card_table::Card_id;
+
+    static Card_store& instance();
+
+    /// Map partition and find newest valid table. Returns false if the
+    /// partition is missing or holds no valid table.
+    bool open();
+
+    /// Look up card in stored table
+    bool find(Card_id id, Card_table::User_info& info) const;
+
+    /// Number of cards in stored table
+    size_t size() const;
+
+    /// When the stored table was fetched
+    time_t get_timestamp() const;
+
+    /// Store table, unless it is identical to the stored one.
+    /// Must only be called from one task.
+    bool save(const Card_table& table, time_t timestamp);
+
+private:
+    Card_store() = default;
+
+    struct Slot
+    {
+        const uint8_t* entries = nullptr;
+        card_format::Header header;
+    };
+
+    const esp_partition_t* partition = nullptr;
+    const uint8_t* mapped = nullptr;
+    esp_partition_mmap_handle_t mmap_handle;
+    size_t slot_size = 0;
+    Slot slots[2];
+    /// Index of slot holding newest table, or -1
+    std::atomic<int> active = -1;
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
@@ -1,8 +1,8 @@
 #include "controller.h"
 
-#include "cJSON.h"
-
+#include <algorithm>
 #include <random>
+#include <stdint.h>
 #include <time.h>
 
 #include "cardreader.h"
@@ -10,11 +10,15 @@
 #include "display.h"
 #include "format.h"
 #include "hw.h"
+#include "inputs.h"
+#include "jsonwriter.h"
 #include "mqtt.h"
 #include "nvs.h"
 
 #include "esp_app_desc.h"
 #include "esp_random.h"
+#include "esp_sntp.h"
+#include "esp_system.h"
 #include "esp_wifi.h"
 
 #ifdef DEBUG_HEAP
@@ -27,20 +31,21 @@ static heap_trace_record_t trace_record[NUM_RECORDS]; // This buffer must be in
 #endif // DEBUG_HEAP
 
 static constexpr const char* TAG = "ctlr";
+static constexpr auto LOG_MODULE = Log_module::Controller;
 
 static constexpr const char* SPACE_CLOSED_JSON = "{\"status\": \"closed\"}";
 static constexpr const char* SPACE_OPEN_JSON = "{\"status\": \"open\"}";
 
 static constexpr auto UNLOCKED_ALERT_INTERVAL = std::chrono::seconds(30);
 
+static constexpr auto TEMP_STATUS_SHOWN_FOR = std::chrono::seconds(10);
+
 // How long to keep the door open after valid card is presented
 static constexpr auto ENTER_TIME = std::chrono::seconds(6);
 
 // How long to wait before locking when door is closed after leaving
 static constexpr auto LEAVE_TIME = std::chrono::seconds(3);
 
-static constexpr auto TEMP_STATUS_SHOWN_FOR = std::chrono::seconds(10);
-
 // Time door is unlocked after pressing Green
 static constexpr auto UNLOCK_PERIOD = std::chrono::minutes(15);
 static constexpr auto UNLOCK_WARN = std::chrono::minutes(10);
@@ -52,7 +57,30 @@ static constexpr auto ENTER_UNLOCKED_WARN = std::chrono::minutes(5);
 
 static constexpr auto SPACE_STATUS_ANNOUNCE_INTERVAL = std::chrono::seconds(60);
 
+// Device status is published when it changes, and at this interval.
+// Liveness is tracked by the MQTT Last Will, so this can be long.
+static constexpr auto STATUS_KEEPALIVE_INTERVAL = std::chrono::minutes(30);
+
+static constexpr auto TRAFFIC_REPORT_INTERVAL = std::chrono::hours(1);
+
+// Earliest reboot after startup
+static constexpr auto MIN_UPTIME_BEFORE_REBOOT = std::chrono::minutes(15);
+
+// Longest sleep. Keeps the tick count calculation from overflowing.
+static constexpr int64_t MAX_WAIT_US = 60*60*1000000LL;
+
+static constexpr const char* event_names[] = {
+    "card",
+    "button",
+    "door",
+    "action",
+    "clock",
+    "mqtt",
+    "deadline",
+};
+
 Controller* Controller::the_instance = nullptr;
+std::atomic<TaskHandle_t> Controller::task = nullptr;
 
 Controller::Controller(Display& d,
                        Card_reader& r)
@@ -60,9 +88,7 @@ Controller::Controller(Display& d,
       reader(r)
 {
     the_instance = this;
-    time_t now;
-    time(&now);
-    util::make_timestamp(now, boot_timestamp, true);
+    util::make_timestamp(get_wall_time(), boot_timestamp, true);
 #ifdef DEBUG_HEAP
     ESP_ERROR_CHECK(heap_trace_init_standalone(trace_record, NUM_RECORDS));
 #endif
@@ -78,13 +104,103 @@ bool Controller::exists()
     return the_instance != nullptr;
 }
 
+void Controller::notify(uint32_t events)
+{
+    const TaskHandle_t t = task;
+    if (t)
+        xTaskNotify(t, events, eSetBits);
+}
+
+void Controller::time_synced(struct timeval*)
+{
+    notify(EVENT_CLOCK);
+}
+
+static void add_press(Buttons::Keys& keys, Inputs::Id id)
+{
+    switch (id)
+    {
+    case Inputs::Id::Red:
+        keys.red = true;
+        break;
+    case Inputs::Id::White:
+        keys.white = true;
+        break;
+    case Inputs::Id::Green:
+        keys.green = true;
+        break;
+    case Inputs::Id::Leave:
+        keys.leave = true;
+        break;
+    case Inputs::Id::Door:
+        break;
+    }
+}
+
+TickType_t Controller::get_wait_ticks(int64_t now_us) const
+{
+    const auto wait_us = std::clamp<int64_t>(deadlines.next() - now_us, 0, MAX_WAIT_US);
+    // Round up, so we do not wake up just before the deadline
+    return (wait_us*configTICK_RATE_HZ + 999999)/1000000;
+}
+
+void Controller::update_wall_clock_deadlines(int64_t now_us)
+{
+    const time_t now = get_wall_time();
+    auto at = [now, now_us](time_t t)
+    {
+        return now_us + static_cast<int64_t>(t - now)*1000000;
+    };
+    time_t next_change;
+    is_thursday = util::is_it_thursday(now, next_change);
+    deadlines.set(Deadlines::Thursday, at(next_change));
+
+    const auto min_uptime_us = std::chrono::duration_cast<std::chrono::microseconds>(MIN_UPTIME_BEFORE_REBOOT).count();
+    const time_t earliest = now + std::max<int64_t>(0, start_us + min_uptime_us - now_us)/1000000;
+    deadlines.set(Deadlines::Reboot, at(util::next_utc_time(earliest, 2, reboot_minute)));
+}
+
+void Controller::trace_events(uint32_t events, int64_t duration_us)
+{
+    auto add = [duration_us](Event_trace& trace)
+    {
+        ++trace.count;
+        trace.total_us += duration_us;
+        trace.max_us = std::max(trace.max_us, duration_us);
+    };
+    if (!events)
+        add(event_traces[NOF_EVENT_TRACES - 1]);
+    for (int i = 0; i < NOF_EVENT_TRACES - 1; ++i)
+        if (events & (1 << i))
+            add(event_traces[i]);
+    MQTT_LOGV(LOG_MODULE, "Events 0x%x handled in %d us",
+              static_cast<unsigned>(events), static_cast<int>(duration_us));
+}
+
+void Controller::log_event_traces()
+{
+    std::string s;
+    for (int i = 0; i < NOF_EVENT_TRACES; ++i)
+    {
+        auto& trace = event_traces[i];
+        if (!trace.count)
+            continue;
+        s += format(" %s %d (avg %d max %d us)", event_names[i], trace.count,
+                    static_cast<int>(trace.total_us/trace.count), static_cast<int>(trace.max_us));
+        trace = Event_trace();
+    }
+    MQTT_LOGI(LOG_MODULE, "Events:%s", s.c_str());
+}
+
 void Controller::run()
 {
-    std::map<State, std::function<void(Controller*)>> state_map;
-    state_map[State::initial] = &Controller::handle_initial;
-    state_map[State::locked] = &Controller::handle_locked;
-    state_map[State::open] = &Controller::handle_open;
-    state_map[State::timed_unlock] = &Controller::handle_timed_unlock;
+    // Indexed by State
+    static constexpr void (Controller::*state_handlers[door_state::NOF_STATES])() = {
+        &Controller::handle_initial,
+        &Controller::handle_locked,
+        &Controller::handle_open,
+        &Controller::handle_timed_unlock,
+    };
 
     display.clear();
     is_main = get_is_main() || (get_identifier() == std::string("main"));
@@ -94,82 +210,134 @@ void Controller::run()
     int loops = 0;
 #endif
     
-    util::time_point last_gateway_update = util::now() - std::chrono::minutes(1);
     bool last_is_locked = false;
     bool last_is_door_open = false;
-    const auto start_time = util::now();
+    start_us = get_monotonic_us();
 
     std::default_random_engine generator(esp_random()); // HW RNG seed
     std::uniform_int_distribution<int> distribution(10, 40);
-    int reboot_minute = distribution(generator);
-
-    set_mqtt_device_status();
+    reboot_minute = distribution(generator);
+    update_wall_clock_deadlines(start_us);
+
+    set_mqtt_device_status(true);
+    uint32_t last_connect_count = Mqtt::instance().get_connect_count();
+    deadlines.set(Deadlines::Traffic, start_us, TRAFFIC_REPORT_INTERVAL);
+    uint32_t last_bytes_published = 0;
+
+    // Get woken up as soon as something happens
+    task = xTaskGetCurrentTaskHandle();
+    Mqtt::instance().set_listener(task, EVENT_ACTION, EVENT_MQTT);
+    Inputs::instance().start(task, EVENT_BUTTON, EVENT_DOOR);
+    sntp_set_time_sync_notification_cb(&Controller::time_synced);
     
 #ifdef SIMULATE_UNKNOWN_CARD
     int uk_count = 0;
 #endif
+    // Run the initial state right away
+    bool state_changed = true;
     while (1)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        // Sleep until something happens or the next deadline.
+        // Run the new state's handler right away after a state change.
+        uint32_t events = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &events,
+                        state_changed ? 0 : get_wait_ticks(get_monotonic_us()));
+        const auto now_us = get_monotonic_us();
 
-        const auto current_time = util::now();
+        if ((events & EVENT_CLOCK) || deadlines.expired(Deadlines::Thursday, now_us))
+            update_wall_clock_deadlines(now_us);
 
         display.update();
 
-        set_relay(!is_locked);
-
         // Get input
-        is_door_open = get_door_open();
-        
-        keys = read_keys();
+        // A press that is released before we get here still counts
+        Buttons::Keys pressed;
+        Inputs::Event event;
+        while (Inputs::instance().get_event(event))
+        {
+            MQTT_LOGD(LOG_MODULE, "Input %s %s %d ms ago", Inputs::get_name(event.id),
+                      event.active ? "on" : "off",
+                      static_cast<int>((get_monotonic_us() - event.time_us)/1000));
+            if (event.active)
+                add_press(pressed, event.id);
+        }
+        keys = Inputs::instance().get_keys();
+        keys.red |= pressed.red;
+        keys.white |= pressed.white;
+        keys.green |= pressed.green;
+        keys.leave |= pressed.leave;
+        is_door_open = Inputs::instance().is_door_open();
 
         card_id = reader.get_and_clear_card_id();
         if (card_id)
-            Mqtt::instance().log(format("Card " CARD_ID_FORMAT " swiped", card_id));
+            MQTT_LOGI(LOG_MODULE, "Card " CARD_ID_FORMAT " swiped", card_id);
 
-        bool gateway_update_needed = false;
-        if ((is_locked != last_is_locked) || (is_door_open != last_is_door_open))
-        {
-            Mqtt::instance().log(format("Lock status %s door %s",
-                                        is_locked ? "locked" : "unlocked",
-                                        is_door_open ? "open" : "closed"));
-            last_is_locked = is_locked;
-            last_is_door_open = is_door_open;
-            gateway_update_needed = true;
-        }
-        if (!util::is_valid(last_gateway_update) ||
-            current_time - last_gateway_update > std::chrono::seconds(15))
-            gateway_update_needed = true;
+        check_action();
+        // Birth message, immediate acks and spilled messages are published
+        // from here, not from the MQTT event handler
+        Mqtt::instance().process();
 
-        if (gateway_update_needed)
+        if (deadlines.expired(Deadlines::Traffic, now_us))
         {
-            check_action();
-            set_mqtt_device_status();
-            last_gateway_update = current_time;
+            const auto bytes_published = Mqtt::instance().get_bytes_published();
+            MQTT_LOGI(LOG_MODULE, "MQTT: %u bytes published in %d min, free heap %u",
+                      static_cast<unsigned>(bytes_published - last_bytes_published),
+                      static_cast<int>(std::chrono::duration_cast<std::chrono::minutes>(TRAFFIC_REPORT_INTERVAL).count()),
+                      static_cast<unsigned>(esp_get_free_heap_size()));
+            const auto stats = Mqtt::instance().get_outbox_stats();
+            MQTT_LOGI(LOG_MODULE, "MQTT outbox: dropped %d/%d/%d spilled %d replayed %d pending %d lost %d",
+                      stats.dropped_debug, stats.dropped_normal, stats.dropped_audit,
+                      stats.spilled, stats.replayed, stats.spill_pending,
+                      stats.spill_overwritten);
+            log_event_traces();
             int rssi = 0;
             const auto err = esp_wifi_sta_get_rssi(&rssi);
             if (err == ESP_OK)
-                Mqtt::instance().log(format("AP RSSI %d", rssi));
+                MQTT_LOGI(LOG_MODULE, "AP RSSI %d", rssi);
             else
-                Mqtt::instance().log(format("RSSI error: %d", err));
+                MQTT_LOGE(LOG_MODULE, "RSSI error: %d", err);
+            last_bytes_published = bytes_published;
+            deadlines.set(Deadlines::Traffic, now_us, TRAFFIC_REPORT_INTERVAL);
         }
 
         // Handle state
-        auto it = state_map.find(state);
-        if (it == state_map.end())
-            fatal_error(format("Unhandled state %d", static_cast<int>(state)).c_str());
-        const auto old_state = state;
-        it->second(this);
-
-        if (state != old_state)
-            printf("New state: %d\n", static_cast<int>(state));
+        const auto old_state = machine.get();
+        (this->*state_handlers[door_state::index(old_state)])();
+        state_changed = machine.get() != old_state;
         if (util::is_valid(timeout_dur))
         {
-            Mqtt::instance().log(format("Set timeout of %d s",
-                                        std::chrono::duration_cast<std::chrono::seconds>(timeout_dur).count()));
-            timeout = current_time + timeout_dur;
+            MQTT_LOGD(LOG_MODULE, "Set timeout of %d s",
+                      static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(timeout_dur).count()));
+            deadlines.set(Deadlines::Timeout, now_us,
+                          std::chrono::duration_cast<std::chrono::microseconds>(timeout_dur));
             timeout_dur = util::invalid_duration();
         }
+        if (machine.get() != State::timed_unlock)
+        {
+            // Only timed_unlock uses these
+            deadlines.clear(Deadlines::Timeout);
+            deadlines.clear(Deadlines::Countdown);
+        }
+        deadlines.set(Deadlines::Display, display.get_next_update_us());
+
+        // The state handler may have locked or unlocked the door, and we
+        // may not wake up again until the next deadline
+        set_relay(!is_locked);
+
+        if ((is_locked != last_is_locked) || (is_door_open != last_is_door_open))
+        {
+            MQTT_LOGI(LOG_MODULE, "Lock status %s door %s",
+                      is_locked ? "locked" : "unlocked",
+                      is_door_open ? "open" : "closed");
+            last_is_locked = is_locked;
+            last_is_door_open = is_door_open;
+        }
+
+        // Only publishes if something changed, or keepalive is due.
+        // Peers forget our status when we go offline, so resend it on reconnect.
+        const auto connect_count = Mqtt::instance().get_connect_count();
+        set_mqtt_device_status(connect_count != last_connect_count);
+        last_connect_count = connect_count;
 
 #ifdef DEBUG_HEAP
         ++loops;
@@ -192,59 +360,71 @@ void Controller::run()
         }
 #endif
 
-        const auto since_start = current_time - start_time;
-        if (since_start > std::chrono::minutes(15))
+        if (deadlines.expired(Deadlines::Reboot, now_us))
         {
-            time_t t;
-            time(&t);
-            struct tm tm;
-            gmtime_r(&t, &tm);
-            if (tm.tm_hour == 2 && tm.tm_min == reboot_minute)
-            {
-                Mqtt::instance().log("Scheduled reboot");
-                display.set_status("Rebooting", TFT_RED);
-                display.update();
-                vTaskDelay(60000 / portTICK_PERIOD_MS);
-                esp_restart();
-            }
+            MQTT_LOGI(LOG_MODULE, "Scheduled reboot");
+            display.set_status("Rebooting", TFT_RED);
+            display.update();
+            vTaskDelay(60000 / portTICK_PERIOD_MS);
+            esp_restart();
         }
+
+        trace_events(events, get_monotonic_us() - now_us);
+    }
+}
+
+void Controller::transition(Trigger trigger)
+{
+    const auto from = machine.get();
+    if (!machine.fire(trigger))
+    {
+        MQTT_LOGE(LOG_MODULE, "No transition from %s on %s", door_state::name(from), door_state::name(trigger));
+        return;
     }
+    MQTT_LOGI(LOG_MODULE, "State %s -> %s on %s", door_state::name(from),
+              door_state::name(machine.get()), door_state::name(trigger));
 }
 
 void Controller::handle_initial()
 {
     reader.set_pattern(Card_reader::Pattern::ready);
-    state = State::locked;
+    transition(Trigger::start);
 }
 
 void Controller::handle_locked()
 {
     is_locked = true;
     reader.set_pattern(Card_reader::Pattern::ready);
-    std::string aux_status;
     if (is_main)
     {
-        const auto open_doors = Mqtt::instance().get_open_doors();
-        if (!open_doors.empty())
-            aux_status = format("Open: %s", open_doors.c_str());
-        const auto present_cards = Mqtt::instance().get_present_cards();
-        if (!present_cards.empty())
+        const auto version = Mqtt::instance().get_fleet_version();
+        if (version != fleet_version)
         {
-            if (!aux_status.empty())
-                aux_status += "\n";
-            aux_status = format("Cards forgot in: %s", present_cards.c_str());
+            // Status of other devices has changed
+            fleet_version = version;
+            fleet_aux_status.clear();
+            const auto open_doors = Mqtt::instance().get_open_doors();
+            if (!open_doors.empty())
+                fleet_aux_status = format("Open: %s", open_doors.c_str());
+            const auto present_cards = Mqtt::instance().get_present_cards();
+            if (!present_cards.empty())
+            {
+                if (!fleet_aux_status.empty())
+                    fleet_aux_status += "\n";
+                fleet_aux_status += format("Cards forgot in: %s", present_cards.c_str());
+            }
         }
     }
-    display.set_status("Locked", TFT_ORANGE, aux_status, TFT_RED);
+    display.set_status("Locked", TFT_ORANGE, fleet_aux_status, TFT_RED);
     Mqtt::instance().set_slack_status(":lock: Door is locked");
 
     if (keys.white)
         check_thursday();
     else if (keys.green)
     {
-        Mqtt::instance().log("Green pressed");
+        MQTT_LOGI(LOG_MODULE, "Green pressed");
         timeout_dur = UNLOCK_PERIOD;
-        state = State::timed_unlock;
+        transition(Trigger::green);
     }
     else if (card_id)
     {
@@ -254,7 +434,7 @@ void Controller::handle_locked()
     {
         is_locked = false;
         set_relay(true);
-        state = State::timed_unlock;
+        transition(Trigger::leave);
         timeout_dur = LEAVE_TIME;
         Mqtt::instance().write_slack(":exit: The Leave button has been pressed");
     }
@@ -275,8 +455,8 @@ void Controller::handle_open()
     display.set_status("Open", TFT_GREEN, aux_status, TFT_RED);
     if (!is_it_thursday())
     {
-        Mqtt::instance().log("It is no longer Thursday");
-        state = State::locked;
+        MQTT_LOGI(LOG_MODULE, "It is no longer Thursday");
+        transition(Trigger::end_of_thursday);
         if (is_main)
         {
             Mqtt::instance().slack_announce_closed();
@@ -292,7 +472,7 @@ void Controller::handle_open()
             set_mqtt_space_status(SPACE_CLOSED_JSON);
         }
         is_space_open = false;
-        state = State::locked;
+        transition(Trigger::red);
     }
     // Allow scanning new cards while open
     if (card_id)
@@ -302,16 +482,24 @@ void Controller::handle_open()
 void Controller::handle_timed_unlock()
 {
     is_locked = false;
-    if (keys.red || (util::is_valid(timeout) && util::now() >= timeout))
+    const auto now_us = get_monotonic_us();
+    if (keys.red || deadlines.expired(Deadlines::Timeout, now_us))
     {
-        timeout = util::invalid_time_point();
-        state = State::locked;
+        deadlines.clear(Deadlines::Timeout);
+        transition(keys.red ? Trigger::red : Trigger::timeout);
     }
     else if (keys.white)
         check_thursday();
-    else if (util::is_valid(timeout))
+    else if (keys.leave)
     {
-        const auto time_left = timeout - util::now();
+        // Restart the timeout, as when leaving from locked
+        transition(Trigger::leave);
+        timeout_dur = LEAVE_TIME;
+        Mqtt::instance().write_slack(":exit: The Leave button has been pressed");
+    }
+    else if (deadlines.is_set(Deadlines::Timeout))
+    {
+        const auto time_left = std::chrono::microseconds(deadlines.get(Deadlines::Timeout) - now_us);
         if (time_left > std::chrono::seconds(10))
         {
             const int secs_left = std::chrono::duration_cast<std::chrono::seconds>(time_left).count();
@@ -325,17 +513,22 @@ void Controller::handle_timed_unlock()
                 colour = TFT_ORANGE;
             }
             display.set_status("Open for\n"+s2, colour);
+            deadlines.set(Deadlines::Countdown, now_us, std::chrono::seconds(1));
         }
+        else
+            // Countdown is over. An expired deadline would keep the
+            // controller loop from sleeping.
+            deadlines.clear(Deadlines::Countdown);
     }
-    if (!util::is_valid(timeout))
-        state = State::locked;
+    if (machine.get() == State::timed_unlock && !deadlines.is_set(Deadlines::Timeout))
+        transition(Trigger::timeout);
 }
 
 bool Controller::is_it_thursday() const
 {
     if (Mqtt::instance().get_allow_open())
         return true;
-    return util::is_it_thursday();
+    return is_thursday;
 }
 
 void Controller::check_thursday()
@@ -345,7 +538,7 @@ void Controller::check_thursday()
         display.show_message("It is not\nThursday yet", TFT_RED);
         return;
     }
-    state = State::open;
+    transition(Trigger::white_on_thursday);
     if (is_main)
     {
         Mqtt::instance().slack_announce_open();
@@ -354,10 +547,6 @@ void Controller::check_thursday()
     is_space_open = true;
 }
 
-Buttons::Keys Controller::read_keys(bool log)
-{
-    return buttons.read();
-}
 
 void Controller::check_card(Card_id card_id, bool change_state)
 {
@@ -371,7 +560,7 @@ void Controller::check_card(Card_id card_id, bool change_state)
             set_relay(true);
             display.show_message("Valid card swiped");
             reader.set_pattern(Card_reader::Pattern::enter);
-            state = State::timed_unlock;
+            transition(Trigger::card);
             timeout_dur = ENTER_TIME;
         }
         break;
@@ -379,7 +568,7 @@ void Controller::check_card(Card_id card_id, bool change_state)
     case Card_cache::Access::Forbidden:
         display.show_message(format("Blocked card " CARD_ID_FORMAT " swiped", card_id), TFT_YELLOW);
         Mqtt::instance().write_slack(":bandit: Unauthorized card swiped", Mqtt::ChannelInfo);
-        Mqtt::instance().log(format("Unauthorized card " CARD_ID_FORMAT " swiped", card_id));
+        MQTT_LOGI(LOG_MODULE, "Unauthorized card " CARD_ID_FORMAT " swiped", card_id);
         break;
             
     case Card_cache::Access::Unknown:
@@ -396,43 +585,42 @@ void Controller::check_card(Card_id card_id, bool change_state)
     }
 }
 
-void Controller::set_mqtt_device_status()
+void Controller::set_mqtt_device_status(bool force)
 {
+    const Device_status current{ is_door_open, is_space_open, is_locked };
+    const auto now_us = get_monotonic_us();
+    if (!force && current == last_device_status &&
+        !deadlines.expired(Deadlines::Status, now_us))
+        return;
+    last_device_status = current;
+    deadlines.set(Deadlines::Status, now_us, STATUS_KEEPALIVE_INTERVAL);
+
     char timestamp[util::TIMESTAMP_SIZE];
     util::make_timestamp(timestamp, true);
-    auto payload = cJSON_CreateObject();
-    cJSON_wrapper jw(payload);
-    auto jtimestamp = cJSON_CreateString(timestamp);
-    cJSON_AddItemToObject(payload, "timestamp", jtimestamp);
-
-    auto status = cJSON_CreateObject();
-    auto door = cJSON_CreateString(is_door_open ? "open" : "closed");
-    cJSON_AddItemToObject(status, "door", door);
-    auto space = cJSON_CreateString(is_space_open ? "open" : "closed");
-    cJSON_AddItemToObject(status, "space", space);
-    auto lock = cJSON_CreateString(is_locked ? "locked" : "unlocked");
-    cJSON_AddItemToObject(status, "lock_status", lock);
-    auto boot_time_string = cJSON_CreateString(boot_timestamp);
-    cJSON_AddItemToObject(status, "boot_time", boot_time_string);
-
+    char heartbeat[util::TIMESTAMP_SIZE];
     {
         std::lock_guard<std::mutex> g(card_reader_heartbeat_mutex);
-        util::make_timestamp(last_card_reader_heartbeat, timestamp, true);
+        util::make_timestamp(last_card_reader_heartbeat, heartbeat, true);
     }
-    auto heartbeat = cJSON_CreateString(timestamp);
-    cJSON_AddItemToObject(status, "card_reader_heartbeat", heartbeat);
-    auto version = cJSON_CreateString(esp_app_get_description()->version);
-    cJSON_AddItemToObject(status, "version", version);
-    cJSON_AddItemToObject(payload, "data", status);
-    char* data = cJSON_PrintUnformatted(payload);
-    if (!data)
+    Json_writer payload(status_buffer, sizeof(status_buffer));
+    payload.begin_object();
+    payload.key("timestamp").string(timestamp);
+    payload.key("data").begin_object();
+    payload.key("door").string(is_door_open ? "open" : "closed");
+    payload.key("space").string(is_space_open ? "open" : "closed");
+    payload.key("lock_status").string(is_locked ? "locked" : "unlocked");
+    payload.key("boot_time").string(boot_timestamp);
+    payload.key("card_reader_heartbeat").string(heartbeat);
+    payload.key("version").string(esp_app_get_description()->version);
+    payload.end_object();
+    payload.end_object();
+    if (!payload.ok())
     {
-        ESP_LOGE(TAG, "cJSON_Print() returned nullptr");
+        ESP_LOGE(TAG, "Device status too large");
         return;
     }
-    cJSON_Print_wrapper pw(data);
 
-    Mqtt::instance().set_status(data);
+    Mqtt::instance().set_status(payload.c_str());
 }
 
 void Controller::set_mqtt_space_status(const char* status)
@@ -442,29 +630,38 @@ void Controller::set_mqtt_space_status(const char* status)
 
 void Controller::check_action()
 {
-    std::string action, arg;
-    std::tie(action, arg) = Mqtt::instance().get_and_clear_action();
-    if (action.empty())
-        return;
-    
-    Mqtt::instance().log(format("Start action '%s'", action.c_str()));
+    Mqtt::Action pending;
+    while (Mqtt::instance().get_next_action(pending))
+        handle_action(pending);
+}
+
+void Controller::handle_action(const Mqtt::Action& pending)
+{
+    const auto& action = pending.action;
+    const auto& arg = pending.arg;
+    MQTT_LOGI(LOG_MODULE, "Start action '%s'", action.c_str());
     if (action == "lock")
     {
         if (is_door_open)
             Mqtt::instance().write_slack(":warning: Door is open", Mqtt::ChannelInfo);
         is_locked = true;
+        set_relay(false);
+        Mqtt::instance().ack_action(pending, "ok");
         Mqtt::instance().write_slack(":lock: Door locked remotely", Mqtt::ChannelInfo);
-        state = State::locked;
+        transition(Trigger::remote_lock);
     }
     else if (action == "unlock")
     {
         is_locked = false;
+        set_relay(true);
+        Mqtt::instance().ack_action(pending, "ok");
         Mqtt::instance().write_slack(":unlock: Door unlocked remotely", Mqtt::ChannelInfo);
-        state = State::timed_unlock;
-        timeout = util::now() + GW_UNLOCK_PERIOD;
+        transition(Trigger::remote_unlock);
+        deadlines.set(Deadlines::Timeout, get_monotonic_us(), GW_UNLOCK_PERIOD);
     }
     else if (action == "reboot")
     {
+        Mqtt::instance().ack_action(pending, "ok");
         Mqtt::instance().write_slack(":power: Rebooting", Mqtt::ChannelInfo);
         vTaskDelay(10000 / portTICK_PERIOD_MS);
         esp_restart();
@@ -473,19 +670,41 @@ void Controller::check_action()
     {
         Mqtt::instance().write_slack(":secret: ACS token set");
         set_acs_token(arg.c_str());
+        Mqtt::instance().ack_action(pending, "ok");
+    }
+    else if (action == "setloglevel")
+    {
+        // arg is e.g. "cc=debug,ctlr=error". Serial output stays capped
+        // at CONFIG_LOG_MAXIMUM_LEVEL, see Log_levels::set().
+        if (Log_levels::set(arg))
+        {
+            Mqtt::instance().log(format("Log levels: %s", Log_levels::get().c_str()));
+            Mqtt::instance().ack_action(pending, "ok");
+        }
+        else
+        {
+            MQTT_LOGE(LOG_MODULE, "Invalid log levels '%s'", arg.c_str());
+            Mqtt::instance().ack_action(pending, "invalid");
+        }
+    }
+    else if (action == "ping")
+    {
+        // No side effects. Used for measuring action latency.
+        Mqtt::instance().ack_action(pending, "ok");
     }
     else
     {
-        Mqtt::instance().log(format("Unknown action '%s'", action.c_str()));
+        MQTT_LOGE(LOG_MODULE, "Unknown action '%s'", action.c_str());
         Mqtt::instance().write_slack(format(":question: Unknown action '%s'",
                                             action.c_str()), Mqtt::ChannelInfo);
+        Mqtt::instance().ack_action(pending, "unknown");
     }
 }
 
 void Controller::card_reader_heartbeat()
 {
     std::lock_guard<std::mutex> g(card_reader_heartbeat_mutex);
-    time(&last_card_reader_heartbeat);
+    last_card_reader_heartbeat = get_wall_time();
 }
 
 // Local Variables:
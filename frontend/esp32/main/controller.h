@@ -1,13 +1,20 @@
 #pragma once
 
 #include <RDM6300.h>
+#include <doorstate.h>
 
 #include "buttons.h"
 #include "cardcache.h"
+#include "deadlines.h"
+#include "mqtt.h"
 #include "util.h"
 
+#include <atomic>
 #include <string>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
 class Card_reader;
 class Display;
 
@@ -23,21 +30,48 @@ public:
 
     static bool exists();
 
+    /// Events that wake up the controller loop
+    enum Event : uint32_t
+    {
+        EVENT_CARD = 1 << 0,
+        EVENT_BUTTON = 1 << 1,
+        EVENT_DOOR = 1 << 2,
+        EVENT_ACTION = 1 << 3,
+        /// Wall clock set by SNTP
+        EVENT_CLOCK = 1 << 4,
+        /// Status of other devices changed, MQTT reconnected, or
+        /// Mqtt::process() has work to do
+        EVENT_MQTT = 1 << 5,
+    };
+
+    /// Wake up the controller loop. Does nothing if the loop is not running.
+    static void notify(uint32_t events);
+
     void run();
 
-    Buttons::Keys read_keys(bool do_log = true);
-    
     void card_reader_heartbeat();
     
 private:
     using Card_id = RDM6300::Card_id;
 
-    enum class State {
-        initial,
-        locked,
-        open,
-        timed_unlock,
-    };
+    using State = door_state::State;
+    using Trigger = door_state::Trigger;
+
+    static void time_synced(struct timeval*);
+
+    /// How long to sleep if no events arrive
+    TickType_t get_wait_ticks(int64_t now_us) const;
+
+    /// Find next Thursday change and scheduled reboot. Called daily, and
+    /// when the wall clock is set.
+    void update_wall_clock_deadlines(int64_t now_us);
+
+    /// Record time spent handling events
+    void trace_events(uint32_t events, int64_t duration_us);
+    void log_event_traces();
+
+    /// Change state as given by door_state::TRANSITIONS, and log it
+    void transition(Trigger trigger);
 
     void handle_initial();
     void handle_locked();
@@ -48,16 +82,33 @@ private:
     bool is_it_thursday() const;
     void check_thursday();
     void ensure_lock_state(bool locked);
+    /// Handle all pending MQTT actions
     void check_action();
-    void set_mqtt_device_status();
+    void handle_action(const Mqtt::Action& action);
+    /// Publish device status if it has changed, or keepalive is due
+    void set_mqtt_device_status(bool force = false);
     void set_mqtt_space_status(const char* status);
 
     static Controller* the_instance;
+    /// Task running the controller loop
+    static std::atomic<TaskHandle_t> task;
+    struct Event_trace
+    {
+        int count = 0;
+        int64_t total_us = 0;
+        int64_t max_us = 0;
+    };
+    /// Indexed by event bit number. The last entry is for wakeups with no events.
+    static constexpr int NOF_EVENT_TRACES = 7;
+    Event_trace event_traces[NOF_EVENT_TRACES];
     Display& display;
     Card_reader& reader;
-    Buttons buttons;
-    State state = State::initial;
+    door_state::Machine machine;
     bool is_main = false;
+    /// Mqtt::get_fleet_version() when fleet_aux_status was built
+    uint32_t fleet_version = 0;
+    /// Status of other devices, shown on main device when locked
+    std::string fleet_aux_status;
     bool is_door_open = false;
     bool is_locked = true;
     Buttons::Keys keys;
@@ -66,8 +117,25 @@ private:
     Card_id card_id;
     std::string who;
     util::duration timeout_dur = util::invalid_duration();
-    util::time_point timeout = util::invalid_time_point();
+    Deadlines deadlines;
+    /// get_monotonic_us() at start of run()
+    int64_t start_us = 0;
+    /// Minute past 02:00 UTC of the scheduled reboot
+    int reboot_minute = 0;
+    /// Cached result of util::is_it_thursday()
+    bool is_thursday = false;
     char boot_timestamp[util::TIMESTAMP_SIZE];
+    struct Device_status
+    {
+        bool door_open = false;
+        bool space_open = false;
+        bool locked = false;
+
+        bool operator==(const Device_status&) const = default;
+    };
+    /// Last published device status
+    Device_status last_device_status;
+    char status_buffer[400];
     std::mutex card_reader_heartbeat_mutex;
     time_t last_card_reader_heartbeat = 0;
 };
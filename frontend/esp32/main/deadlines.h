@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <stdint.h>
+
+/// Deadlines on the get_monotonic_us() clock, so they are not
+/// skewed when SNTP steps the wall clock. The controller loop sleeps until
+/// the earliest one.
+class Deadlines
+{
+public:
+    enum Id
+    {
+        /// State timeout (timed_unlock)
+        Timeout,
+        /// Unlock countdown on display
+        Countdown,
+        /// Display message expiry and status line
+        Display,
+        /// Next local midnight, when is_it_thursday() may change
+        Thursday,
+        /// Scheduled reboot
+        Reboot,
+        /// Device status keepalive
+        Status,
+        /// Hourly traffic report
+        Traffic,
+        Count
+    };
+
+    static constexpr int64_t NONE = INT64_MAX;
+
+    void set(Id id, int64_t at_us)
+    {
+        deadlines[id] = at_us;
+    }
+
+    /// Set deadline relative to now_us
+    void set(Id id, int64_t now_us, std::chrono::microseconds delay)
+    {
+        deadlines[id] = now_us + delay.count();
+    }
+
+    void clear(Id id)
+    {
+        deadlines[id] = NONE;
+    }
+
+    bool is_set(Id id) const
+    {
+        return deadlines[id] != NONE;
+    }
+
+    int64_t get(Id id) const
+    {
+        return deadlines[id];
+    }
+
+    /// True if the deadline is set and has passed
+    bool expired(Id id, int64_t now_us) const
+    {
+        return now_us >= deadlines[id];
+    }
+
+    /// Earliest deadline, or NONE
+    int64_t next() const
+    {
+        return *std::min_element(std::begin(deadlines), std::end(deadlines));
+    }
+
+private:
+    int64_t deadlines[Count] = { NONE, NONE, NONE, NONE, NONE, NONE, NONE };
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
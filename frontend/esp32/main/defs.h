@@ -1,5 +1,7 @@
 #pragma once
 
+#include <inttypes.h>
+
 #include <string>
 #include <vector>
 
@@ -39,7 +41,7 @@ constexpr const auto PIN_WHITE = (gpio_num_t) 35;
 constexpr const auto PIN_LEAVE = (gpio_num_t) 33;
 constexpr const auto PIN_DOOR = (gpio_num_t) 22;
 
-#define CARD_ID_FORMAT "%010llX"
+#define CARD_ID_FORMAT "%010" PRIX64
 
 using wifi_creds_t = std::vector<std::pair<std::string, std::string>>;
 
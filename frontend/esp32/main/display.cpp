@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "display.h"
 #include "format.h"
+#include "hw.h"
 #include "mqtt.h"
 
 #include <TFT_eSPI.h>
@@ -14,6 +15,7 @@ static constexpr const auto medium_font = &FreeSansBold18pt7b;
 static constexpr const auto status_font = &FreeSans9pt7b;
 static constexpr const int GFXFF = 1;
 static constexpr const auto MESSAGE_DURATION = std::chrono::seconds(10);
+static constexpr const auto STATUS_LINE_INTERVAL = std::chrono::seconds(60);
 
 static constexpr const char* TAG = "disp";
 
@@ -43,7 +45,9 @@ Display::Display(TFT_eSPI& tft)
 
 void Display::start_uptime_counter()
 {
-    time(&start_time);
+    start_us = get_monotonic_us();
+    // First status line after 1 second
+    next_status_us = start_us + 1000*1000;
 }
 
 void Display::clear()
@@ -69,7 +73,7 @@ void Display::add_progress(const std::string& status)
     --row;
     tft.fillScreen(TFT_BLACK);
     DEBUG(("Scrolling\n"));
-    for (int i = 0; i < lines.size(); ++i)
+    for (size_t i = 0; i < lines.size(); ++i)
     {
         const auto w = tft.textWidth(lines[i].c_str(), GFXFF);
         const auto x = TFT_HEIGHT/2 - w/2;
@@ -144,7 +148,7 @@ void Display::show_text(const std::string& status,
     const auto h = medium_textheight;
     
     const auto lines = split(status);
-    auto nof_lines = lines.size();
+    int nof_lines = lines.size();
     if (!aux_status.empty())
         ++nof_lines;
     auto y = STATUS_HEIGHT + (TFT_WIDTH - STATUS_HEIGHT - LABEL_HEIGHT)/2 - nof_lines/2*h - h/2;
@@ -170,100 +174,100 @@ void Display::show_text(const std::string& status,
 
 void Display::show_message(const std::string& message, uint16_t colour)
 {
-    last_message = util::now();
+    message_until_us = get_monotonic_us() +
+        std::chrono::duration_cast<std::chrono::microseconds>(MESSAGE_DURATION).count();
     clear_status_area();
     show_text(message, colour, "", TFT_BLACK);
 }
 
 void Display::update()
 {
-    if (util::is_valid(last_message) &&
-        util::now() - last_message >= MESSAGE_DURATION)
+    const auto now = get_monotonic_us();
+    if (message_until_us && now >= message_until_us)
     {
         // Clear message, show last status
-        last_message = util::invalid_time_point();
+        message_until_us = 0;
         clear_status_area();
         show_text(last_status, last_status_colour, last_aux_status, last_aux_status_colour);
     }
-    time_t current = 0;
-    time(&current);
-    if (current != last_clock)
+    if (now >= next_status_us)
     {
-        last_clock = current;
-        ++seconds_since_status_update;
-        if (seconds_since_status_update >= 60)
+        next_status_us = now +
+            std::chrono::duration_cast<std::chrono::microseconds>(STATUS_LINE_INTERVAL).count();
+        std::string status;
+        switch (status_page)
         {
-            seconds_since_status_update = 0;
-            std::string status;
-            switch (status_page)
+        case 0:
             {
-            case 0:
-                {
-                    char stamp[util::TIMESTAMP_SIZE];
-                    util::make_timestamp(stamp);
-                    status = format("%s - %s", stamp,
-                                    Mqtt::instance().get_allow_open() ? "AO" : "NO");
-                }
-                break;
+                char stamp[util::TIMESTAMP_SIZE];
+                util::make_timestamp(stamp);
+                status = format("%s - %s", stamp,
+                                Mqtt::instance().get_allow_open() ? "AO" : "NO");
+            }
+            break;
 
-            case 1:
-            case 2:
-                {
-                    time_t now;
-                    time(&now);
-                    const auto uptime = now - start_time;
-                    const int days = uptime/(24*60*60);
-                    int minutes = (uptime - days*24*60*60)/60;
-                    const int hours = minutes/60;
-                    minutes -= hours*60;
-                    const auto mem = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-                    ESP_LOGI(TAG, "Memory %zu", mem);
-                    status = format("%dd%02d:%02d - M%d",
-                                    days, hours, minutes,
-                                    static_cast<int>(mem/1024));
-                }
-                break;
-                
-            case 3:
-                {
-                    const auto ip = get_ip_address();
-                    char ip_buf[4*(3+1)+1];
-                    esp_ip4addr_ntoa(&ip, ip_buf, sizeof(ip_buf));
-                    status = format("V%s - %s",
-                                    esp_app_get_description()->version, ip_buf);
-                }
-                break;
+        case 1:
+        case 2:
+            {
+                const int64_t uptime = (now - start_us)/(1000*1000);
+                const int days = uptime/(24*60*60);
+                int minutes = (uptime - days*24*60*60)/60;
+                const int hours = minutes/60;
+                minutes -= hours*60;
+                const auto mem = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+                ESP_LOGI(TAG, "Memory %zu", mem);
+                status = format("%dd%02d:%02d - M%d",
+                                days, hours, minutes,
+                                static_cast<int>(mem/1024));
             }
-            ++status_page;
-            if (status_page > 3)
-                status_page = 0;
-            // Show status
-            tft.fillRect(0, 0, TFT_HEIGHT, STATUS_HEIGHT, TFT_BLACK);
-            tft.setTextColor(TFT_OLIVE);
-            tft.setFreeFont(status_font);
-            tft.drawString(status.c_str(), 0, 0, GFXFF);
-            // Show labels
-            tft.setFreeFont(small_font);
-            tft.fillRect(0, TFT_WIDTH - LABEL_HEIGHT, TFT_HEIGHT, LABEL_HEIGHT, TFT_BLACK);
-            tft.setTextColor(TFT_GREEN);
-            tft.drawString("Open 15m", 5, TFT_WIDTH - LABEL_HEIGHT, GFXFF);
-            tft.setTextColor(TFT_RED);
-            tft.drawString("Close", TFT_HEIGHT - 60, TFT_WIDTH - LABEL_HEIGHT, GFXFF);
-            tft.setTextColor(TFT_WHITE);
-            std::string label;
-            if (util::is_it_thursday())
-                label = "Thurs";
-            else if (Mqtt::instance().get_allow_open())
-                label = "OPEN";
-            if (!label.empty())
+            break;
+            
+        case 3:
             {
-                const auto w = tft.textWidth(label.c_str(), GFXFF);
-                tft.drawString(label.c_str(), (TFT_HEIGHT - w)/2, TFT_WIDTH - LABEL_HEIGHT, GFXFF);
+                const auto ip = get_ip_address();
+                char ip_buf[4*(3+1)+1];
+                esp_ip4addr_ntoa(&ip, ip_buf, sizeof(ip_buf));
+                status = format("V%s - %s",
+                                esp_app_get_description()->version, ip_buf);
             }
+            break;
+        }
+        ++status_page;
+        if (status_page > 3)
+            status_page = 0;
+        // Show status
+        tft.fillRect(0, 0, TFT_HEIGHT, STATUS_HEIGHT, TFT_BLACK);
+        tft.setTextColor(TFT_OLIVE);
+        tft.setFreeFont(status_font);
+        tft.drawString(status.c_str(), 0, 0, GFXFF);
+        // Show labels
+        tft.setFreeFont(small_font);
+        tft.fillRect(0, TFT_WIDTH - LABEL_HEIGHT, TFT_HEIGHT, LABEL_HEIGHT, TFT_BLACK);
+        tft.setTextColor(TFT_GREEN);
+        tft.drawString("Open 15m", 5, TFT_WIDTH - LABEL_HEIGHT, GFXFF);
+        tft.setTextColor(TFT_RED);
+        tft.drawString("Close", TFT_HEIGHT - 60, TFT_WIDTH - LABEL_HEIGHT, GFXFF);
+        tft.setTextColor(TFT_WHITE);
+        std::string label;
+        if (util::is_it_thursday())
+            label = "Thurs";
+        else if (Mqtt::instance().get_allow_open())
+            label = "OPEN";
+        if (!label.empty())
+        {
+            const auto w = tft.textWidth(label.c_str(), GFXFF);
+            tft.drawString(label.c_str(), (TFT_HEIGHT - w)/2, TFT_WIDTH - LABEL_HEIGHT, GFXFF);
         }
     }
 }
 
+int64_t Display::get_next_update_us() const
+{
+    if (message_until_us && message_until_us < next_status_us)
+        return message_until_us;
+    return next_status_us;
+}
+
 // Local Variables:
 // compile-command: "cd .. && idf.py build"
 // End:
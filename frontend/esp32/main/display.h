@@ -18,6 +18,9 @@ public:
 
     void update();
 
+    /// get_monotonic_us() when update() next has something to do
+    int64_t get_next_update_us() const;
+
     /// Set the persistent status.
     void set_status(const std::string& status,
                     uint16_t colour = TFT_WHITE);
@@ -54,11 +57,10 @@ private:
     std::string last_aux_status;
     uint16_t last_status_colour = 0;
     uint16_t last_aux_status_colour = 0;
-    // Used by show_message()
-    util::time_point last_message = util::invalid_time_point();
+    // Used by show_message(). Times are get_monotonic_us().
+    int64_t message_until_us = 0;
     // Used by update()
-    time_t last_clock = 0;
-    time_t start_time = 0;
-    int seconds_since_status_update = 59; // first update after 1 seconds
+    int64_t start_us = 0;
+    int64_t next_status_us = 0;
     int status_page = 0;
 };
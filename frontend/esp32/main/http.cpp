@@ -5,6 +5,8 @@
 #include "esp_log.h"
 #include "esp_tls.h"
 
+#include <string.h>
+
 int http_max_output = 0;
 int http_output_len = 0;       // Stores number of bytes read
 
@@ -5,7 +5,9 @@
 #include <limits>
 #include <vector>
 
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include <freertos/FreeRTOS.h>
 #include <driver/ledc.h>
@@ -54,3 +56,14 @@ bool get_door_open()
     return gpio_get_level(PIN_DOOR);
 }
 
+int64_t IRAM_ATTR get_monotonic_us()
+{
+    return esp_timer_get_time();
+}
+
+time_t get_wall_time()
+{
+    time_t now;
+    time(&now);
+    return now;
+}
@@ -1,7 +1,26 @@
 #pragma once
 
+#include <stdint.h>
+#include <time.h>
+
+/// Relay, door sensor and clocks. The controller and display take their
+/// time from here, so a build for another platform can replace it with a
+/// virtual clock.
+
 void init_hardware();
 
 void set_relay(bool on);
 
 bool get_door_open();
+
+/// Monotonic time in microseconds since boot. Timeouts and deadlines use
+/// this, so they are not affected when SNTP steps the wall clock.
+/// Safe to call from interrupt handlers.
+int64_t get_monotonic_us();
+
+/// Wall clock time, as set by SNTP
+time_t get_wall_time();
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
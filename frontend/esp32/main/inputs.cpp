@@ -0,0 +1,197 @@
+#include "inputs.h"
+
+#include "defs.h"
+#include "hw.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+
+static constexpr const char* TAG = "inputs";
+
+// Time for contacts to settle after an edge
+static constexpr int DEBOUNCE_MS = 20;
+
+// Events not yet handled by the controller
+static constexpr int QUEUE_SIZE = 16;
+
+Inputs& Inputs::instance()
+{
+    static Inputs the_instance;
+    return the_instance;
+}
+
+void Inputs::start(TaskHandle_t task, uint32_t buttons, uint32_t door)
+{
+    listener = task;
+    button_bits = buttons;
+    door_bits = door;
+    queue = xQueueCreate(QUEUE_SIZE, sizeof(Event));
+    const auto err = gpio_install_isr_service(0);
+    // Already installed is fine
+    if (err != ESP_ERR_INVALID_STATE)
+        ESP_ERROR_CHECK(err);
+    const gpio_num_t pins[NOF_INPUTS] = { PIN_RED, PIN_WHITE, PIN_GREEN, PIN_LEAVE, PIN_DOOR };
+    for (int i = 0; i < NOF_INPUTS; ++i)
+    {
+        auto& input = inputs[i];
+        input.owner = this;
+        input.id = static_cast<Id>(i);
+        input.pin = pins[i];
+        // A press of a button that unlocks the door must be confirmed
+        input.leading_edge = input.id == Id::Red || input.id == Id::White;
+        input.active = sample(input.id);
+        input.debouncing = false;
+        input.edge_us = 0;
+        input.timer = xTimerCreate(get_name(input.id), pdMS_TO_TICKS(DEBOUNCE_MS), pdFALSE,
+                                   &input, &Inputs::timer_callback);
+#ifdef PLATFORM_DEVKIT
+        // No buttons
+        if (input.id != Id::Door)
+            continue;
+#endif
+        ESP_ERROR_CHECK(gpio_set_intr_type(input.pin, GPIO_INTR_ANYEDGE));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(input.pin, &Inputs::isr, &input));
+    }
+}
+
+bool Inputs::get_event(Event& event)
+{
+    return queue && xQueueReceive(queue, &event, 0) == pdTRUE;
+}
+
+Buttons::Keys Inputs::get_keys() const
+{
+    return {
+        inputs[static_cast<int>(Id::Red)].active,
+        inputs[static_cast<int>(Id::White)].active,
+        inputs[static_cast<int>(Id::Green)].active,
+        inputs[static_cast<int>(Id::Leave)].active
+    };
+}
+
+bool Inputs::is_door_open() const
+{
+    return inputs[static_cast<int>(Id::Door)].active;
+}
+
+const char* Inputs::get_name(Id id)
+{
+    switch (id)
+    {
+    case Id::Red:
+        return "red";
+    case Id::White:
+        return "white";
+    case Id::Green:
+        return "green";
+    case Id::Leave:
+        return "leave";
+    case Id::Door:
+        return "door";
+    }
+    return "?";
+}
+
+bool Inputs::sample(Id id)
+{
+    if (id == Id::Door)
+        return get_door_open();
+    const auto keys = Buttons::read();
+    switch (id)
+    {
+    case Id::Red:
+        return keys.red;
+    case Id::White:
+        return keys.white;
+    case Id::Green:
+        return keys.green;
+    case Id::Leave:
+        return keys.leave;
+    default:
+        return false;
+    }
+}
+
+void IRAM_ATTR Inputs::queue_event(const Event& event, BaseType_t* woken)
+{
+    const auto bits = event.id == Id::Door ? door_bits : button_bits;
+    if (woken)
+    {
+        xQueueSendFromISR(queue, &event, woken);
+        xTaskNotifyFromISR(listener, bits, eSetBits, woken);
+    }
+    else
+    {
+        if (xQueueSend(queue, &event, 0) != pdTRUE)
+            ESP_LOGE(TAG, "Queue full");
+        xTaskNotify(listener, bits, eSetBits);
+    }
+}
+
+void IRAM_ATTR Inputs::isr(void* arg)
+{
+    auto& input = *static_cast<Input*>(arg);
+    auto self = input.owner;
+    bool changed = false;
+    Event event;
+    portENTER_CRITICAL_ISR(&self->spinlock);
+    const bool first_edge = !input.debouncing;
+    if (first_edge)
+    {
+        input.debouncing = true;
+        input.edge_us = get_monotonic_us();
+        // Buttons are active low
+        const bool level = gpio_get_level(input.pin);
+        const bool active = input.id == Id::Door ? level : !level;
+        // A spike may be over already, then there is nothing to report
+        if (input.leading_edge && active != input.active)
+        {
+            input.active = active;
+            event = { input.id, active, input.edge_us };
+            changed = true;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&self->spinlock);
+    if (!first_edge)
+        return;
+    BaseType_t woken = pdFALSE;
+    if (changed)
+        self->queue_event(event, &woken);
+    if (xTimerStartFromISR(input.timer, &woken) != pdPASS)
+    {
+        // Timer queue full. Let the next edge try again, or the input
+        // would never report again.
+        portENTER_CRITICAL_ISR(&self->spinlock);
+        input.debouncing = false;
+        portEXIT_CRITICAL_ISR(&self->spinlock);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+void Inputs::timer_callback(TimerHandle_t timer)
+{
+    auto& input = *static_cast<Input*>(pvTimerGetTimerID(timer));
+    auto self = input.owner;
+    bool changed = false;
+    Event event;
+    portENTER_CRITICAL(&self->spinlock);
+    // Settled level. Sampled with the lock held, so an edge after this is
+    // seen by the ISR.
+    const bool active = sample(input.id);
+    if (active != input.active)
+    {
+        input.active = active;
+        // A leading edge input has changed back during the debounce time.
+        // Otherwise the change happened at the first edge.
+        event = { input.id, active, input.leading_edge ? get_monotonic_us() : input.edge_us };
+        changed = true;
+    }
+    input.debouncing = false;
+    portEXIT_CRITICAL(&self->spinlock);
+    if (changed)
+        self->queue_event(event, nullptr);
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
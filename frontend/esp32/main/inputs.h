@@ -0,0 +1,102 @@
+#pragma once
+
+#include "buttons.h"
+
+#include <stdint.h>
+
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+
+/// Debounced buttons and door sensor.
+///
+/// Each input has an any-edge GPIO interrupt. The first edge records the
+/// time and starts a debounce timer, and later edges are ignored until the
+/// timer has sampled the settled level. Red and White report the level read
+/// at the first edge, so they respond at interrupt latency. Green, Leave
+/// and the door sensor only report a change once the level has settled, so
+/// a noise spike cannot unlock the door and contact bounce cannot flip the
+/// door state.
+class Inputs
+{
+public:
+    enum class Id : uint8_t
+    {
+        Red,
+        White,
+        Green,
+        Leave,
+        Door,
+    };
+
+    struct Event
+    {
+        Id id;
+        /// Button pressed or door open
+        bool active;
+        /// get_monotonic_us() of the edge
+        int64_t time_us;
+    };
+
+    static Inputs& instance();
+
+    /// Set up interrupts. When an event is queued, button_bits or door_bits
+    /// are set in the notification value of listener.
+    void start(TaskHandle_t listener, uint32_t button_bits, uint32_t door_bits);
+
+    /// Get next event. Returns false if there is none.
+    bool get_event(Event& event);
+
+    /// Debounced button levels
+    Buttons::Keys get_keys() const;
+
+    /// Debounced door level
+    bool is_door_open() const;
+
+    static const char* get_name(Id id);
+
+private:
+    static constexpr int NOF_INPUTS = static_cast<int>(Id::Door) + 1;
+
+    struct Input
+    {
+        Inputs* owner;
+        Id id;
+        gpio_num_t pin;
+        /// Report level at first edge instead of after settling
+        bool leading_edge;
+        /// Debounced level: pressed or open
+        volatile bool active;
+        /// Edges are ignored while the debounce timer runs
+        volatile bool debouncing;
+        int64_t edge_us;
+        TimerHandle_t timer;
+    };
+
+    Inputs() = default;
+
+    /// Sample level of input, true if pressed or open
+    static bool sample(Id id);
+
+    /// Queue event and notify listener. woken is null when not called
+    /// from the ISR.
+    void queue_event(const Event& event, BaseType_t* woken);
+
+    static void isr(void* arg);
+
+    static void timer_callback(TimerHandle_t timer);
+
+    Input inputs[NOF_INPUTS];
+    QueueHandle_t queue = nullptr;
+    TaskHandle_t listener = nullptr;
+    uint32_t button_bits = 0;
+    uint32_t door_bits = 0;
+    /// Protects the active, debouncing and edge_us members of inputs
+    portMUX_TYPE spinlock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
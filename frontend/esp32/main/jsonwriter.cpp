@@ -0,0 +1,130 @@
+#include "jsonwriter.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+Json_writer::Json_writer(char* _buffer, size_t size)
+    : buffer(_buffer),
+      capacity(size)
+{
+    if (capacity)
+        buffer[0] = 0;
+    else
+        overflow = true;
+}
+
+Json_writer& Json_writer::begin_object()
+{
+    separator();
+    put('{');
+    need_comma = false;
+    return *this;
+}
+
+Json_writer& Json_writer::end_object()
+{
+    put('}');
+    need_comma = true;
+    return *this;
+}
+
+Json_writer& Json_writer::key(std::string_view k)
+{
+    separator();
+    put_escaped(k);
+    put(':');
+    need_comma = false;
+    return *this;
+}
+
+Json_writer& Json_writer::string(std::string_view s)
+{
+    separator();
+    put_escaped(s);
+    need_comma = true;
+    return *this;
+}
+
+Json_writer& Json_writer::number(int64_t n)
+{
+    separator();
+    char s[24];
+    const int n_len = snprintf(s, sizeof(s), "%" PRId64, n);
+    put(std::string_view(s, n_len));
+    need_comma = true;
+    return *this;
+}
+
+Json_writer& Json_writer::boolean(bool b)
+{
+    separator();
+    put(b ? "true" : "false");
+    need_comma = true;
+    return *this;
+}
+
+void Json_writer::separator()
+{
+    if (need_comma)
+        put(',');
+}
+
+void Json_writer::put(char c)
+{
+    // Always leave room for the terminator
+    if (len + 1 >= capacity)
+    {
+        overflow = true;
+        return;
+    }
+    buffer[len++] = c;
+    buffer[len] = 0;
+}
+
+void Json_writer::put(std::string_view s)
+{
+    for (auto c : s)
+        put(c);
+}
+
+void Json_writer::put_escaped(std::string_view s)
+{
+    static constexpr const char* digits = "0123456789abcdef";
+    put('"');
+    for (auto c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            put("\\\"");
+            break;
+        case '\\':
+            put("\\\\");
+            break;
+        case '\n':
+            put("\\n");
+            break;
+        case '\r':
+            put("\\r");
+            break;
+        case '\t':
+            put("\\t");
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                put("\\u00");
+                put(digits[(c >> 4) & 0x0F]);
+                put(digits[c & 0x0F]);
+            }
+            else
+                put(c);
+            break;
+        }
+    }
+    put('"');
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
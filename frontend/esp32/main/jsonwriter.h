@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+/// Writes compact JSON into a caller-supplied buffer, without allocating.
+/// If the buffer is too small, the output is truncated and ok() returns
+/// false.
+///
+///   char buf[100];
+///   Json_writer w(buf, sizeof(buf));
+///   w.begin_object().key("door").string("open").end_object();
+class Json_writer
+{
+public:
+    Json_writer(char* buffer, size_t size);
+
+    Json_writer& begin_object();
+
+    Json_writer& end_object();
+
+    Json_writer& key(std::string_view k);
+
+    Json_writer& string(std::string_view s);
+
+    Json_writer& number(int64_t n);
+
+    Json_writer& boolean(bool b);
+
+    /// False if the buffer was too small
+    bool ok() const
+    {
+        return !overflow;
+    }
+
+    /// Zero terminated output
+    const char* c_str() const
+    {
+        return buffer;
+    }
+
+    size_t size() const
+    {
+        return len;
+    }
+
+private:
+    /// Write comma if this is not the first item
+    void separator();
+
+    void put(char c);
+
+    void put(std::string_view s);
+
+    void put_escaped(std::string_view s);
+
+    char* buffer;
+    size_t capacity;
+    size_t len = 0;
+    bool overflow = false;
+    bool need_comma = false;
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
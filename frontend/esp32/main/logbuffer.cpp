@@ -0,0 +1,55 @@
+#include "logbuffer.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+bool Log_buffer::add(int64_t time_us, const char* text, size_t len)
+{
+    if (len > MAX_LINE)
+        len = MAX_LINE;
+    if (used + LINE_OVERHEAD + len > SIZE)
+    {
+        ++dropped;
+        return false;
+    }
+    uint8_t* p = buffer + used;
+    memcpy(p, &time_us, sizeof(time_us));
+    p[sizeof(time_us)] = static_cast<uint8_t>(len);
+    memcpy(p + LINE_OVERHEAD, text, len);
+    used += LINE_OVERHEAD + len;
+    return true;
+}
+
+size_t Log_buffer::take_batch(int64_t now_us, char* out, size_t out_size)
+{
+    int n = snprintf(out, out_size, "1 %u\n", dropped);
+    if (n < 0 || static_cast<size_t>(n) >= out_size)
+        return 0;
+    size_t out_len = n;
+    size_t pos = 0;
+    while (pos < used)
+    {
+        int64_t time_us;
+        memcpy(&time_us, buffer + pos, sizeof(time_us));
+        const size_t len = buffer[pos + sizeof(time_us)];
+        const int64_t age_ms = (now_us - time_us)/1000;
+        n = snprintf(out + out_len, out_size - out_len, "%" PRId64 "|", age_ms);
+        if (n < 0 || out_len + n + len + 1 > out_size)
+            // Send the rest next time
+            break;
+        out_len += n;
+        memcpy(out + out_len, buffer + pos + LINE_OVERHEAD, len);
+        out_len += len;
+        out[out_len++] = '\n';
+        pos += LINE_OVERHEAD + len;
+    }
+    memmove(buffer, buffer + pos, used - pos);
+    used -= pos;
+    dropped = 0;
+    return out_len;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Fixed size buffer collecting log lines until they are sent as one batch.
+///
+/// Batch format (one line each):
+///
+///   1 <number of lines dropped since last batch>
+///   <age of line in ms>|<text>
+///   ...
+///
+/// The age is relative to when the batch was made, so the receiver can
+/// timestamp each line even if the sender's clock is not set.
+class Log_buffer
+{
+public:
+    /// Bytes available for lines
+    static constexpr size_t SIZE = 2048;
+    /// Longer lines are truncated
+    static constexpr size_t MAX_LINE = 200;
+    /// Size of a buffer that can hold any batch
+    static constexpr size_t BATCH_SIZE = 2*SIZE + 32;
+
+    /// Add a line. If there is no room, the line is dropped and counted.
+    bool add(int64_t time_us, const char* text, size_t len);
+
+    bool empty() const
+    {
+        return used == 0;
+    }
+
+    /// Bytes used by buffered lines
+    size_t bytes() const
+    {
+        return used;
+    }
+
+    /// Format buffered lines as a batch and clear buffer.
+    /// Returns the length of the batch, which is not terminated.
+    size_t take_batch(int64_t now_us, char* out, size_t out_size);
+
+private:
+    // Each line is stored as time (8 bytes), length (1 byte), text
+    static constexpr size_t LINE_OVERHEAD = 9;
+
+    uint8_t buffer[SIZE];
+    size_t used = 0;
+    unsigned dropped = 0;
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
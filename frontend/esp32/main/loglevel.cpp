@@ -0,0 +1,92 @@
+#include "loglevel.h"
+
+#include <iterator>
+#include <string>
+
+static constexpr const char* TAG = "loglevel";
+
+static constexpr const char* module_names[] = {
+    "cc",
+    "ctlr",
+    "card",
+};
+static_assert(std::size(module_names) == static_cast<size_t>(Log_module::Count));
+
+// Indexed by esp_log_level_t
+static constexpr const char* level_names[] = {
+    "none",
+    "error",
+    "warn",
+    "info",
+    "debug",
+    "verbose",
+};
+static_assert(std::size(level_names) == ESP_LOG_VERBOSE + 1);
+
+std::atomic<esp_log_level_t> Log_levels::levels[static_cast<int>(Log_module::Count)] = {
+    ESP_LOG_INFO, ESP_LOG_INFO, ESP_LOG_INFO
+};
+
+static int find_name(const char* const* names, size_t n, std::string_view name)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (name == names[i])
+            return i;
+    return -1;
+}
+
+bool Log_levels::set(std::string_view spec)
+{
+    // Parse everything before changing anything
+    esp_log_level_t new_levels[std::size(module_names)];
+    for (size_t i = 0; i < std::size(module_names); ++i)
+        new_levels[i] = levels[i];
+    while (!spec.empty())
+    {
+        const auto comma = spec.find(',');
+        const auto item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        const auto eq = item.find('=');
+        if (eq == std::string_view::npos)
+            return false;
+        const auto module = item.substr(0, eq);
+        const int level = find_name(level_names, std::size(level_names), item.substr(eq + 1));
+        if (level < 0)
+            return false;
+        if (module == "*")
+        {
+            for (auto& l : new_levels)
+                l = static_cast<esp_log_level_t>(level);
+            continue;
+        }
+        const int index = find_name(module_names, std::size(module_names), module);
+        if (index < 0)
+            return false;
+        new_levels[index] = static_cast<esp_log_level_t>(level);
+    }
+    for (size_t i = 0; i < std::size(module_names); ++i)
+    {
+        levels[i] = new_levels[i];
+        esp_log_level_set(module_names[i], new_levels[i]);
+    }
+    ESP_LOGI(TAG, "Levels: %s", get().c_str());
+    return true;
+}
+
+std::string Log_levels::get()
+{
+    std::string spec;
+    for (size_t i = 0; i < std::size(module_names); ++i)
+    {
+        if (!spec.empty())
+            spec += ",";
+        spec += module_names[i];
+        spec += "=";
+        spec += level_names[levels[i].load()];
+    }
+    return spec;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
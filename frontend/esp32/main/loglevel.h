@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+
+#include "esp_log.h"
+
+/// Modules with their own MQTT log level. The names are the modules' log tags.
+enum class Log_module
+{
+    Card_cache,
+    Controller,
+    Card_reader,
+    Count
+};
+
+/// Runtime log level of each module, for both the MQTT debug log and
+/// ESP_LOGx. All modules start at ESP_LOG_INFO.
+class Log_levels
+{
+public:
+    /// True if messages of this level should be logged by the module.
+    /// Only costs a load and a compare.
+    static bool enabled(Log_module module, esp_log_level_t level)
+    {
+        return level <= levels[static_cast<int>(module)].load(std::memory_order_relaxed);
+    }
+
+    /// Set levels from a spec like "cc=debug,ctlr=error". "*" selects all
+    /// modules. Levels are none, error, warn, info, debug and verbose.
+    /// Debug and verbose only reach the serial log if the firmware is built
+    /// with CONFIG_LOG_MAXIMUM_LEVEL that high (it is 3, info, in sdkconfig).
+    /// The MQTT log is not limited.
+    /// Returns false if the spec is invalid, in which case nothing is changed.
+    static bool set(std::string_view spec);
+
+    /// Format all levels as a spec
+    static std::string get();
+
+private:
+    static std::atomic<esp_log_level_t> levels[static_cast<int>(Log_module::Count)];
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
@@ -54,6 +54,9 @@ void app_main()
 
     init_nvs();
 
+    // Allow entry even before we are online
+    Card_cache::instance().load_stored_table();
+
     display.add_progress(format("ID %s", get_identifier().c_str()));
 
     bool connected = false;
@@ -1,17 +1,49 @@
 #include "esp_system.h"
 #include "esp_event.h"
-#include "psa/crypto.h"
+#include "esp_timer.h"
 
+#include <algorithm>
+#include <string.h>
 #include <string>
 
 #include "cJSON.h"
 #include "defs.h"
-#include "format.h"
+#include "jsonwriter.h"
 #include "mqtt.h"
 #include "nvs.h"
+#include "signer.h"
+#include "statusparser.h"
 
 static constexpr const char* TAG = "mqtt";
 
+// Outbox size (bytes) above which messages of each priority are not
+// enqueued. Audit messages are spilled to flash instead.
+static constexpr int DEBUG_OUTBOX_LIMIT = 4*1024;
+static constexpr int NORMAL_OUTBOX_LIMIT = 12*1024;
+static constexpr int AUDIT_OUTBOX_LIMIT = 20*1024;
+// Hard limit enforced by the MQTT client
+static constexpr int OUTBOX_LIMIT = 32*1024;
+
+// Spilled messages replayed per log timer tick
+static constexpr int SPILL_REPLAY_PER_TICK = 2;
+
+// Actions received but not yet handled by the controller
+static constexpr size_t MAX_PENDING_ACTIONS = 8;
+
+// Longer messages are truncated
+static constexpr size_t MAX_SLACK_MESSAGE_SIZE = 400;
+
+// Send buffered log messages at this interval, or when this much is buffered
+static constexpr int LOG_FLUSH_INTERVAL_MS = 1000;
+static constexpr size_t LOG_FLUSH_BYTES = Log_buffer::SIZE/2;
+
+// MQTT keepalive. The broker publishes our Last Will ("offline") when it has
+// not heard from us for 1.5 times this interval.
+static constexpr int KEEPALIVE_S = 20;
+
+static constexpr const char* ONLINE = "online";
+static constexpr const char* OFFLINE = "offline";
+
 Mqtt& Mqtt::instance()
 {
     static Mqtt the_instance;
@@ -20,46 +52,131 @@ Mqtt& Mqtt::instance()
 
 std::string Mqtt::get_open_doors()
 {
-    std::string s;
-    std::lock_guard<std::mutex> g(door_status_mutex);
-    for (const auto& e : door_status)
+    std::lock_guard<std::mutex> g(fleet_mutex);
+    return open_doors;
+}
+
+std::string Mqtt::get_present_cards()
+{
+    std::lock_guard<std::mutex> g(fleet_mutex);
+    return present_cards;
+}
+
+int Mqtt::get_device_index(std::string_view device)
+{
+    const auto it = device_index.find(device);
+    if (it != device_index.end())
+        return it->second;
+    const int index = device_index.size();
+    if (index >= MAX_DEVICES)
+        return -1;
+    device_index.emplace(std::string(device), index);
+    return index;
+}
+
+void Mqtt::update_fleet_status(std::string_view device,
+                               const Status_fields& fields)
+{
+    std::lock_guard<std::mutex> g(fleet_mutex);
+    const int index = get_device_index(device);
+    if (index < 0)
+    {
+        ESP_LOGE(TAG, "Too many devices");
+        return;
+    }
+    const uint32_t bit = 1u << index;
+    auto set_bit = [bit](uint32_t& bits, bool on)
+    {
+        const auto old_bits = bits;
+        bits = on ? (bits | bit) : (bits & ~bit);
+        return bits != old_bits;
+    };
+    bool changed = false;
+    // Get door open/unlocked status for other frontend devices
+    if (!fields.door.empty() && !fields.lock_status.empty())
     {
-        if (e.second.first || e.second.second)
+        const bool is_door_open = fields.door == "open";
+        const bool is_unlocked = fields.lock_status == "unlocked";
+        ESP_LOGD(TAG, "Door open: %d unlocked: %d", is_door_open, is_unlocked);
+        changed |= set_bit(door_open_bits, is_door_open);
+        changed |= set_bit(unlocked_bits, is_unlocked);
+    }
+    // Get card_present status for bigbro devices
+    if (fields.card_present >= 0)
+        changed |= set_bit(card_present_bits, fields.card_present);
+    if (!changed)
+        return;
+
+    // Device names in alphabetical order
+    open_doors.clear();
+    present_cards.clear();
+    for (const auto& e : device_index)
+    {
+        const uint32_t b = 1u << e.second;
+        if ((door_open_bits | unlocked_bits) & b)
         {
-            if (!s.empty())
-                s += ", ";
-            if (e.second.first)
+            if (!open_doors.empty())
+                open_doors += ", ";
+            if (door_open_bits & b)
                 // Door is open
-                s += "*";
-            s += e.first;
+                open_doors += "*";
+            open_doors += e.first;
+        }
+        if (card_present_bits & b)
+        {
+            if (!present_cards.empty())
+                present_cards += ", ";
+            present_cards += e.first;
         }
     }
-    return s;
+    ++fleet_version;
+    notify_listener(status_bits);
 }
 
-std::string Mqtt::get_present_cards()
+bool Mqtt::get_next_action(Action& action)
+{
+    std::lock_guard<std::mutex> g(action_mutex);
+    if (actions.empty())
+        return false;
+    action = std::move(actions.front());
+    actions.pop_front();
+    return true;
+}
+
+void Mqtt::ack_action(const Action& action, const char* result)
 {
-    std::string s;
-    std::lock_guard<std::mutex> g(card_present_mutex);
-    for (const auto& e : card_present_status)
+    const auto latency_ms = (esp_timer_get_time() - action.received)/1000;
+    char topic[MAX_TOPIC_SIZE];
+    snprintf(topic, sizeof(topic), "hal9k/acs/ack/%s", identifier.c_str());
+    char buffer[200];
+    Json_writer payload(buffer, sizeof(buffer));
+    payload.begin_object();
+    payload.key("stamp").number(action.stamp);
+    payload.key("action").string(action.action);
+    payload.key("result").string(result);
+    payload.key("latency_ms").number(latency_ms);
+    payload.end_object();
+    if (!payload.ok())
     {
-        if (e.second)
-        {
-            if (!s.empty())
-                s += ", ";
-            s += e.first;
-        }
+        ESP_LOGE(TAG, "Ack too large");
+        return;
     }
-    return s;
+    const auto msg_id = publish(topic, payload.c_str(), payload.size(), 1, false, Priority::Normal);
+    ESP_LOGI(TAG, "Q ack %d", msg_id);
 }
 
-std::pair<std::string, std::string> Mqtt::get_and_clear_action()
+void Mqtt::set_listener(TaskHandle_t task, uint32_t actions, uint32_t status)
 {
-    std::lock_guard<std::mutex> g(action_mutex);
-    const auto result = std::make_pair(current_action, current_action_arg);
-    current_action.clear();
-    current_action_arg.clear();
-    return result;
+    action_bits = actions;
+    status_bits = status;
+    listener = task;
+}
+
+void Mqtt::notify_listener(uint32_t bits)
+{
+    const TaskHandle_t task = listener;
+    if (task)
+        xTaskNotify(task, bits, eSetBits);
 }
 
 bool Mqtt::get_allow_open() const
@@ -82,8 +199,13 @@ void Mqtt::event_handler(void* handler_args,
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "Connected");
         self->connected = true;
-        esp_mqtt_client_subscribe(event->client, "hal9k/acs/status/#", 1);
-        esp_mqtt_client_subscribe(event->client, "hal9k/acs/action/#", 1);
+        for (const auto& route : self->routes)
+            esp_mqtt_client_subscribe(event->client, route.filter, 1);
+        // The birth message is published by process(). Publishing from
+        // here would take outbox_mutex while the client holds its API lock.
+        self->birth_pending = true;
+        ++self->connect_count;
+        self->notify_listener(self->status_bits);
         break;
 
     case MQTT_EVENT_DISCONNECTED:
@@ -101,8 +223,8 @@ void Mqtt::event_handler(void* handler_args,
 
     case MQTT_EVENT_DATA:
         ESP_LOGD(TAG, "Got data");
-        self->handle_data(std::string(event->topic, event->topic_len),
-                          std::string(event->data, event->data_len));
+        self->handle_data(std::string_view(event->topic, event->topic_len),
+                          std::string_view(event->data, event->data_len));
         break;
         
     case MQTT_EVENT_ERROR:
@@ -115,212 +237,320 @@ void Mqtt::event_handler(void* handler_args,
     }
 }
 
-void Mqtt::handle_data(const std::string& full_topic,
-                       const std::string& data)
+void Mqtt::handle_data(std::string_view topic,
+                       std::string_view data)
 {
-    constexpr size_t PREFIX_LEN = strlen("hal9k/acs/");
-    if (full_topic.size() < PREFIX_LEN)
+    for (const auto& route : routes)
+    {
+        // Filter without "/#" matches the topic itself and all subtopics
+        const std::string_view filter(route.filter);
+        const auto prefix = filter.substr(0, filter.size() - 2);
+        if (!topic.starts_with(prefix))
+            continue;
+        const auto rest = topic.substr(prefix.size());
+        if (rest.empty())
+            (this->*route.handler)(rest, data);
+        else if (rest[0] == '/')
+            (this->*route.handler)(rest.substr(1), data);
+        else
+            continue;
         return;
-    // Remove "hal9k/acs/" part
-    std::string topic = full_topic.substr(PREFIX_LEN);
-    if (topic.starts_with("status"))
-        handle_status(topic, data);
-    else if (topic.starts_with("action"))
-        // hal9k/acs/action/tester {"text": "dummy None", "stamp": 1783926100, "hash": "57c5241d4234b91e58f51893270d1480eda0adc8f96b15663fd7b0b5e5ec47d4"}
-        handle_action(topic, data);
+    }
+    ESP_LOGD(TAG, "No route for %.*s", static_cast<int>(topic.size()), topic.data());
 }
 
-void Mqtt::handle_status(const std::string& topic,
-                         const std::string& data)
+void Mqtt::handle_status(std::string_view device,
+                         std::string_view data)
 {
-    // Remove "status/" part
-    constexpr size_t PREFIX_LEN = strlen("status/");
-    if (topic.size() < PREFIX_LEN)
-        return;
-    const auto device = topic.substr(PREFIX_LEN);
-    ESP_LOGD(TAG, "Status device: %s", device.c_str());
-    if (device == get_identifier())
+    ESP_LOGD(TAG, "Status device: %.*s", static_cast<int>(device.size()), device.data());
+    if (device.empty() || device == identifier)
         // Skip myself
         return;
-    auto root = cJSON_Parse(data.c_str());
-    cJSON_wrapper jwr(root);
-    if (!root)
-    {
-        ESP_LOGE(TAG, "Bad JSON from %s: %s", topic.c_str(), data.c_str());
+    if (data.empty())
+        // Retained status was removed
         return;
-    }
-    auto data_node = cJSON_GetObjectItem(root, "data");
-    if (data_node && data_node->type == cJSON_Object)
+    Status_fields fields;
+    if (!parse_status(data, fields))
     {
-        auto door_node = cJSON_GetObjectItem(data_node, "door");
-        auto lock_status_node = cJSON_GetObjectItem(data_node, "lock_status");
-        // Get door open/unlocked status for other frontend devices
-        if (door_node && door_node->type == cJSON_String)
-        {
-            const bool is_door_open = !strcmp(door_node->valuestring, "open");
-            ESP_LOGD(TAG, "Door open: %d", is_door_open);
-            if (lock_status_node && lock_status_node->type == cJSON_String)
-            {
-                const bool is_unlocked = !strcmp(lock_status_node->valuestring, "unlocked");
-                ESP_LOGD(TAG, "Unlocked: %d", is_unlocked);
-                std::lock_guard<std::mutex> g(door_status_mutex);
-                door_status[device] = std::make_pair(is_door_open, is_unlocked);
-            }
-        }
-        // Get card_present status for bigbro devices
-        auto card_present_node = cJSON_GetObjectItem(data_node, "card_present");
-        if (card_present_node &&
-            ((card_present_node->type == cJSON_False) ||
-             (card_present_node->type == cJSON_True)))
-        {
-            std::lock_guard<std::mutex> g(card_present_mutex);
-            card_present_status[device] = card_present_node->type == cJSON_True;
-        }
+        ESP_LOGE(TAG, "Bad JSON from %.*s: %.*s",
+                 static_cast<int>(device.size()), device.data(),
+                 static_cast<int>(data.size()), data.data());
+        return;
     }
+    update_fleet_status(device, fields);
 }
 
-void Mqtt::handle_action(const std::string& topic,
-                         const std::string& data)
+void Mqtt::handle_online(std::string_view device,
+                         std::string_view data)
 {
-    ESP_LOGI(TAG, "action topic: %s", topic.c_str());
-    if (topic.contains("/"))
+    if (device.empty() || device == identifier || data != OFFLINE)
+        return;
+    ESP_LOGI(TAG, "%.*s is offline", static_cast<int>(device.size()), device.data());
+    // Its last status no longer applies
+    Status_fields fields;
+    fields.door = "closed";
+    fields.lock_status = "locked";
+    fields.card_present = 0;
+    update_fleet_status(device, fields);
+}
+
+void Mqtt::handle_action(std::string_view device,
+                         std::string_view data)
+{
+    if (!device.empty())
     {
-        constexpr size_t PREFIX_LEN = strlen("action/");
-        const auto device = topic.substr(PREFIX_LEN);
-        ESP_LOGI(TAG, "Action device: %s", device.c_str());
-        if (device != get_identifier())
+        ESP_LOGI(TAG, "Action device: %.*s", static_cast<int>(device.size()), device.data());
+        if (device != identifier)
             // Not me
             return;
     }
-    else if (topic != "action")
-    {
-        ESP_LOGE(TAG, "Bad global action topic: %s", topic.c_str());
-        return;
-    }
-    auto root = cJSON_Parse(data.c_str());
+    // hal9k/acs/action/tester {"text": "dummy None", "stamp": 1783926100, "hash": "57c5241d4234b91e58f51893270d1480eda0adc8f96b15663fd7b0b5e5ec47d4"}
+    auto root = cJSON_ParseWithLength(data.data(), data.size());
     cJSON_wrapper jwr(root);
     if (root)
     {
         if (!check_signature(root))
         {
-            ESP_LOGE(TAG, "Bad action signature in %s", data.c_str());
+            ESP_LOGE(TAG, "Bad action signature in %.*s", static_cast<int>(data.size()), data.data());
             return;
         }
         auto action_node = cJSON_GetObjectItem(root, "action");
         if (action_node && action_node->type == cJSON_String)
         {
-            std::string action_arg;
+            Action action;
+            action.action = action_node->valuestring;
             auto arg_node = cJSON_GetObjectItem(root, "arg");
             if (arg_node && arg_node->type == cJSON_String)
-                action_arg = arg_node->valuestring;
-            std::lock_guard<std::mutex> g(action_mutex);
-            if (action_arg == "open" || action_arg == "close")
+                action.arg = arg_node->valuestring;
+            // check_signature() has verified that stamp is present
+            action.stamp = cJSON_GetNumberValue(cJSON_GetObjectItem(root, "stamp"));
+            action.received = esp_timer_get_time();
             {
-                allow_open = action_arg == "open";
-                ESP_LOGI(TAG, "allow open: %d", allow_open);
-            }
-            else
-            {
-                current_action = action_node->valuestring;
-                current_action_arg = action_arg;
-                ESP_LOGI(TAG, "action: %s", current_action.c_str());
+                std::lock_guard<std::mutex> g(action_mutex);
+                const char* result = nullptr;
+                if (action.arg == "open" || action.arg == "close")
+                {
+                    allow_open = action.arg == "open";
+                    ESP_LOGI(TAG, "allow open: %d", allow_open);
+                    result = "ok";
+                }
+                else if (actions.size() >= MAX_PENDING_ACTIONS)
+                {
+                    ESP_LOGE(TAG, "Action queue full, dropping %s", action.action.c_str());
+                    result = "dropped";
+                }
+                else
+                {
+                    ESP_LOGI(TAG, "action: %s", action.action.c_str());
+                    actions.push_back(action);
+                }
+                // Acks are published by process(), not from the event handler
+                if (result && acks.size() < MAX_PENDING_ACTIONS)
+                    acks.push_back({ action, result });
             }
+            // Wake up the controller so the action, or the new allow open
+            // state, is handled right away
+            notify_listener(action_bits);
         }
     }
 }
 
 void Mqtt::log(const std::string& msg)
 {
-    const auto topic = format("hal9k/acs/log/%s", get_identifier().c_str());
-    const auto msg_id = esp_mqtt_client_enqueue(client, topic.c_str(),
-                                                msg.c_str(), 0, 1, 0, true);
-    ESP_LOGI(TAG, "Q log %d", msg_id);
+    bool flush = false;
+    {
+        std::lock_guard<std::mutex> g(log_mutex);
+        if (!log_buffer.add(esp_timer_get_time(), msg.c_str(), msg.size()))
+            ESP_LOGW(TAG, "Log buffer full");
+        flush = log_buffer.bytes() >= LOG_FLUSH_BYTES;
+    }
+    if (flush)
+        flush_log();
 }
 
-void Mqtt::set_status(const char* data,
-                      const char* subtopic)
+void Mqtt::flush_log()
 {
-    const auto topic = format("hal9k/acs/status/%s",
-                              subtopic ? subtopic : get_identifier().c_str());
-    const auto msg_id = esp_mqtt_client_enqueue(client, topic.c_str(),
-                                                data, 0,
-                                                // QoS, retain
-                                                1, 1, true);
-    ESP_LOGI(TAG, "Q status %d", msg_id);
+    if (!connected)
+        // Keep lines in buffer rather than filling the outbox
+        return;
+    std::lock_guard<std::mutex> g(log_mutex);
+    if (log_buffer.empty())
+        return;
+    const auto len = log_buffer.take_batch(esp_timer_get_time(), log_batch, sizeof(log_batch));
+    char topic[MAX_TOPIC_SIZE];
+    snprintf(topic, sizeof(topic), "hal9k/acs/logbatch/%s", identifier.c_str());
+    const auto msg_id = publish(topic, log_batch, len, 1, false, Priority::Debug);
+    ESP_LOGI(TAG, "Q log %d", msg_id);
 }
 
-bool Mqtt::sign(cJSON* payload, const std::string& message)
+void Mqtt::log_timer_callback(void* arg)
 {
-    time_t now;
-    time(&now);
-    auto stamp = cJSON_CreateNumber(now);
-    cJSON_AddItemToObject(payload, "stamp", stamp);
+    auto self = reinterpret_cast<Mqtt*>(arg);
+    self->flush_log();
+    // Spilled messages are replayed by process(), as replaying writes to
+    // flash, which must not block the esp_timer task
+    if (self->connected && self->get_nof_spilled() > 0)
+        self->notify_listener(self->status_bits);
+}
 
-    // Initialize PSA Crypto
-    psa_status_t status = psa_crypto_init();
-    if (status != PSA_SUCCESS)
+void Mqtt::process()
+{
+    if (birth_pending.exchange(false))
+        // Birth message, replacing the retained Last Will
+        publish(online_topic, ONLINE, strlen(ONLINE),
+                // QoS, retain
+                1, true, Priority::Normal);
+    while (1)
     {
-        ESP_LOGE(TAG, "PSA crypto init failed: %d", status);
-        return false;
+        Pending_ack ack;
+        {
+            std::lock_guard<std::mutex> g(action_mutex);
+            if (acks.empty())
+                break;
+            ack = std::move(acks.front());
+            acks.pop_front();
+        }
+        ack_action(ack.action, ack.result);
     }
+    replay_spilled();
+}
 
-    // Compute SHA256 of secret + timestamp + message using PSA API
-    uint8_t sha[PSA_HASH_MAX_SIZE];
-    size_t sha_len;
-    
-    psa_hash_operation_t hash_op = PSA_HASH_OPERATION_INIT;
-    status = psa_hash_setup(&hash_op, PSA_ALG_SHA_256);
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_setup failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
-    }
+int Mqtt::get_nof_spilled()
+{
+    std::lock_guard<std::mutex> g(outbox_mutex);
+    return spill_ring.get_nof_pending();
+}
 
-    status = psa_hash_update(&hash_op, get_private_key(), SIGNING_KEY_SIZE);
-    if (status != PSA_SUCCESS)
+int Mqtt::publish(const char* topic, const char* data, size_t len,
+                  int qos, bool retain, Priority priority)
+{
+    // Never call the client while holding outbox_mutex: the client holds
+    // its API lock while running event_handler()
+    const int outbox_size = client ? esp_mqtt_client_get_outbox_size(client) : 0;
     {
-        ESP_LOGE(TAG, "psa_hash_update (secret) failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
+        std::lock_guard<std::mutex> g(outbox_mutex);
+        switch (priority)
+        {
+        case Priority::Debug:
+            if (outbox_size > DEBUG_OUTBOX_LIMIT)
+            {
+                ++outbox_stats.dropped_debug;
+                return -1;
+            }
+            break;
+
+        case Priority::Normal:
+            if (outbox_size > NORMAL_OUTBOX_LIMIT)
+            {
+                ++outbox_stats.dropped_normal;
+                return -1;
+            }
+            break;
+
+        case Priority::Audit:
+            // Keep in flash rather than in the outbox while offline
+            if (!connected || outbox_size > AUDIT_OUTBOX_LIMIT || spill_ring.get_nof_pending())
+            {
+                if (spill_ring.add(topic, std::string_view(data, len)))
+                    ++outbox_stats.spilled;
+                else
+                    ++outbox_stats.dropped_audit;
+                return -1;
+            }
+            break;
+        }
     }
+    bytes_published += len;
+    return esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, true);
+}
 
-    status = psa_hash_update(&hash_op, (const uint8_t*) &now, sizeof(now));
-    if (status != PSA_SUCCESS)
+void Mqtt::replay_spilled()
+{
+    for (int i = 0; i < SPILL_REPLAY_PER_TICK; ++i)
     {
-        ESP_LOGE(TAG, "psa_hash_update (timestamp) failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
+        if (!connected || get_nof_spilled() == 0)
+            return;
+        if (esp_mqtt_client_get_outbox_size(client) > DEBUG_OUTBOX_LIMIT)
+            // Wait until the outbox has drained
+            return;
+        size_t data_size = 0;
+        {
+            std::lock_guard<std::mutex> g(outbox_mutex);
+            std::string_view topic, data;
+            if (!spill_ring.get_oldest(topic, data))
+                return;
+            // Copy, as publish() may overwrite the ring's buffer. The topic
+            // is not terminated in the ring.
+            snprintf(replay_topic, sizeof(replay_topic), "%.*s",
+                     static_cast<int>(topic.size()), topic.data());
+            memcpy(replay_data, data.data(), data.size());
+            data_size = data.size();
+        }
+        const auto msg_id = esp_mqtt_client_enqueue(client, replay_topic, replay_data, data_size, 1, 0, true);
+        if (msg_id < 0)
+            return;
+        bytes_published += data_size;
+        std::lock_guard<std::mutex> g(outbox_mutex);
+        // Does nothing if the record was overwritten in the meantime
+        spill_ring.mark_replayed();
+        ++outbox_stats.replayed;
     }
+}
 
-    status = psa_hash_update(&hash_op, (const uint8_t*) message.c_str(), message.size());
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_update (message) failed: %d", status);
-        psa_hash_abort(&hash_op);
+Mqtt::Outbox_stats Mqtt::get_outbox_stats()
+{
+    std::lock_guard<std::mutex> g(outbox_mutex);
+    auto stats = outbox_stats;
+    stats.spill_pending = spill_ring.get_nof_pending();
+    stats.spill_overwritten = spill_ring.get_nof_overwritten();
+    return stats;
+}
+
+void Mqtt::set_status(const char* data,
+                      const char* subtopic)
+{
+    char topic[MAX_TOPIC_SIZE];
+    snprintf(topic, sizeof(topic), "hal9k/acs/status/%s",
+             subtopic ? subtopic : identifier.c_str());
+    const auto msg_id = publish(topic, data, strlen(data),
+                                // QoS, retain
+                                1, true, Priority::Normal);
+    ESP_LOGI(TAG, "Q status %d", msg_id);
+}
+
+bool Mqtt::sign(Json_writer& payload, std::string_view message)
+{
+    time_t now;
+    time(&now);
+    payload.key("stamp").number(now);
+
+    char hex_hash[Signer::HEX_SIZE];
+    if (!Signer::instance().sign(&now, sizeof(now), message.data(), message.size(), hex_hash))
         return false;
-    }
+    payload.key("hash").string(hex_hash);
+    payload.key("identifier").string(identifier);
+    payload.key("text").string(message);
+    return true;
+}
 
-    status = psa_hash_finish(&hash_op, sha, sizeof(sha), &sha_len);
-    if (status != PSA_SUCCESS)
+bool Mqtt::publish_signed(const char* topic, std::string_view message,
+                          Priority priority, int user_id)
+{
+    std::lock_guard<std::mutex> g(payload_mutex);
+    Json_writer payload(payload_buffer, sizeof(payload_buffer));
+    payload.begin_object();
+    if (user_id >= 0)
+        payload.key("user_id").number(user_id);
+    if (!sign(payload, message))
+        return false;
+    payload.end_object();
+    if (!payload.ok())
     {
-        ESP_LOGE(TAG, "psa_hash_finish failed: %d", status);
-        psa_hash_abort(&hash_op);
+        ESP_LOGE(TAG, "Payload too large for %s", topic);
         return false;
     }
-
-    std::string hex_hash;
-    for (int i = 0; i < SIGNING_KEY_SIZE; ++i)
-        hex_hash += format("%02x", sha[i]);
-    auto hash = cJSON_CreateString(hex_hash.c_str());
-    cJSON_AddItemToObject(payload, "hash", hash);
-
-    auto ident = cJSON_CreateString(get_identifier().c_str());
-    cJSON_AddItemToObject(payload, "identifier", ident);
-
-    auto text = cJSON_CreateString(message.c_str());
-    cJSON_AddItemToObject(payload, "text", text);
-    
+    const auto msg_id = publish(topic, payload.c_str(), payload.size(), 1, false, priority);
+    ESP_LOGI(TAG, "Q %s %d", topic, msg_id);
     return true;
 }
 
@@ -345,113 +575,26 @@ bool Mqtt::check_signature(const cJSON* root)
         return false;
     }
 
-    psa_status_t status = psa_crypto_init();
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "PSA crypto init failed: %d", status);
-        return false;
-    }
-
-    uint8_t sha[PSA_HASH_MAX_SIZE];
-    size_t sha_len;
-    
-    psa_hash_operation_t hash_op = PSA_HASH_OPERATION_INIT;
-    status = psa_hash_setup(&hash_op, PSA_ALG_SHA_256);
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_setup failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
-    }
-
-    status = psa_hash_update(&hash_op, get_private_key(), SIGNING_KEY_SIZE);
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_update (secret) failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
-    }
-
+    // The stamp is hashed as a size_t
     const size_t stamp = stamp_node->valueint;
-    status = psa_hash_update(&hash_op, (const uint8_t*) &stamp, sizeof(stamp));
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_update (timestamp) failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
-    }
-
     const char* message = text_node->valuestring;
-    status = psa_hash_update(&hash_op, (const uint8_t*) message, strlen(message));
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_update (message) failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
-    }
-
-    status = psa_hash_finish(&hash_op, sha, sizeof(sha), &sha_len);
-    if (status != PSA_SUCCESS)
-    {
-        ESP_LOGE(TAG, "psa_hash_finish failed: %d", status);
-        psa_hash_abort(&hash_op);
-        return false;
-    }
-
-    std::string hex_hash;
-    for (int i = 0; i < SIGNING_KEY_SIZE; ++i)
-        hex_hash += format("%02x", sha[i]);
     const char* message_hash = hash_node->valuestring;
-    if (!strcmp(hex_hash.c_str(), message_hash))
+    if (Signer::instance().verify(&stamp, sizeof(stamp), message, strlen(message), message_hash))
         return true;
-    ESP_LOGE(TAG, "Hash mismatch: %s vs %s", hex_hash.c_str(), message_hash);
+    ESP_LOGE(TAG, "Hash mismatch: %s", message_hash);
     return false;
 }
 
 void Mqtt::log_backend(int user_id, const std::string& message)
 {
-    auto payload = cJSON_CreateObject();
-    cJSON_wrapper jw(payload);
-    auto uid = cJSON_CreateNumber(user_id);
-    cJSON_AddItemToObject(payload, "user_id", uid);
-
-    if (!sign(payload, message))
-        return;
-    
-    char* data = cJSON_PrintUnformatted(payload);
-    if (!data)
-    {
-        ESP_LOGE(TAG, "cJSON_Print() returned nullptr");
-        return;
-    }
-    cJSON_Print_wrapper pw(data);
-
-    const auto msg_id = esp_mqtt_client_enqueue(client, "hal9k/acs/backend/log",
-                                                data,
-                                                0, 1, 0, true);
-    ESP_LOGI(TAG, "Q backend %d", msg_id);
+    publish_signed("hal9k/acs/backend/log", message, Priority::Audit, user_id);
 }
 
 void Mqtt::log_unknown_card(Card_id card_id)
 {
-    auto payload = cJSON_CreateObject();
-    cJSON_wrapper jw(payload);
-
-    if (!sign(payload, format(CARD_ID_FORMAT, card_id)))
-        return;
-    
-    char* data = cJSON_PrintUnformatted(payload);
-    if (!data)
-    {
-        ESP_LOGE(TAG, "cJSON_Print() returned nullptr");
-        return;
-    }
-    cJSON_Print_wrapper pw(data);
-
-    const auto msg_id = esp_mqtt_client_enqueue(client, "hal9k/acs/backend/unknown_card",
-                                                data,
-                                                0, 1, 0, true);
-    ESP_LOGI(TAG, "Q unknown_card %d", msg_id);
+    char message[16];
+    snprintf(message, sizeof(message), CARD_ID_FORMAT, card_id);
+    publish_signed("hal9k/acs/backend/unknown_card", message, Priority::Audit);
 }
 
 void Mqtt::write_slack(const std::string& msg,
@@ -462,31 +605,20 @@ void Mqtt::write_slack(const std::string& msg,
         "general", "jeg-står-herude-og-banker-på", "private-monitoring"
     };
 
-    for (int i = 0; i < sizeof(channels)/sizeof(Channel); ++i)
+    for (size_t i = 0; i < sizeof(channels)/sizeof(Channel); ++i)
     {
         if (!(channel & channels[i]))
             continue;
         const auto channel_name = channel_names[i];
 
-        const std::string message = format("%s|%s", msg.c_str(), channel_name);
-
-        auto payload = cJSON_CreateObject();
-        cJSON_wrapper jw(payload);
+        char message[MAX_SLACK_MESSAGE_SIZE];
+        // Truncate the message, not the channel suffix
+        const int max_len = sizeof(message) - 2 - strlen(channel_name);
+        const int len = std::min<int>(msg.size(), max_len);
+        snprintf(message, sizeof(message), "%.*s|%s", len, msg.c_str(), channel_name);
 
-        if (!sign(payload, message))
-            return;
-    
-        char* data = cJSON_PrintUnformatted(payload);
-        if (!data)
-        {
-            ESP_LOGE(TAG, "cJSON_Print() returned nullptr");
+        if (!publish_signed("hal9k/acs/backend/slack", message, Priority::Normal))
             return;
-        }
-        cJSON_Print_wrapper pw(data);
-    
-        const auto msg_id = esp_mqtt_client_enqueue(client, "hal9k/acs/backend/slack",
-                                                    data, 0, 1, 0, true);
-        ESP_LOGI(TAG, "Q Slack %d", msg_id);
     }
 }
 
@@ -521,16 +653,36 @@ void Mqtt::slack_announce_closed()
 
 void Mqtt::start(const std::string& mqtt_address)
 {
+    identifier = get_identifier();
     std::string mqtt_url = std::string("mqtt://") + mqtt_address;
     esp_mqtt_client_config_t mqtt_cfg = {
     };
     ESP_LOGI(TAG, "URL %s", mqtt_url.c_str());
     mqtt_cfg.broker.address.uri = mqtt_url.c_str();
+    mqtt_cfg.outbox.limit = OUTBOX_LIMIT;
+    mqtt_cfg.session.keepalive = KEEPALIVE_S;
+    snprintf(online_topic, sizeof(online_topic), "hal9k/acs/online/%s", identifier.c_str());
+    mqtt_cfg.session.last_will.topic = online_topic;
+    mqtt_cfg.session.last_will.msg = OFFLINE;
+    mqtt_cfg.session.last_will.qos = 1;
+    mqtt_cfg.session.last_will.retain = true;
+    {
+        std::lock_guard<std::mutex> g(outbox_mutex);
+        spill_ring.open();
+    }
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client,
                                    static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID),
                                    &Mqtt::event_handler, this);
     esp_mqtt_client_start(client);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = &Mqtt::log_timer_callback,
+        .arg = this,
+        .name = "mqttlog"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &log_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(log_timer, LOG_FLUSH_INTERVAL_MS*1000));
 }
 
 // Local Variables:
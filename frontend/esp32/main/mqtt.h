@@ -1,14 +1,41 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <map>
 #include <mutex>
 #include <string>
+#include <string_view>
 
 #include "RDM6300.h"
+#include "format.h"
+#include "jsonwriter.h"
+#include "logbuffer.h"
+#include "loglevel.h"
+#include "spillring.h"
+#include "statusparser.h"
 #include "util.h"
 
+#include "esp_timer.h"
 #include "mqtt_client.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/// Log to MQTT if the level is enabled for the module. The message is
+/// only formatted if it is going to be logged.
+#define MQTT_LOG(module, level, ...)                                    \
+    do {                                                                \
+        if (Log_levels::enabled(module, level))                         \
+            Mqtt::instance().log(format(__VA_ARGS__));                  \
+    } while (0)
+
+#define MQTT_LOGE(module, ...) MQTT_LOG(module, ESP_LOG_ERROR, __VA_ARGS__)
+#define MQTT_LOGW(module, ...) MQTT_LOG(module, ESP_LOG_WARN, __VA_ARGS__)
+#define MQTT_LOGI(module, ...) MQTT_LOG(module, ESP_LOG_INFO, __VA_ARGS__)
+#define MQTT_LOGD(module, ...) MQTT_LOG(module, ESP_LOG_DEBUG, __VA_ARGS__)
+#define MQTT_LOGV(module, ...) MQTT_LOG(module, ESP_LOG_VERBOSE, __VA_ARGS__)
+
 /// MQTT singleton
 class Mqtt
 {
@@ -17,12 +44,24 @@ public:
 
     static Mqtt& instance();
 
-    /// Connect to MQTT 
+    /// Connect to MQTT. hal9k/acs/online/<ident> is set to "online" (retained)
+    /// on connect, and the broker sets it to "offline" when we disappear.
     void start(const std::string& mqtt_address);
 
-    /// Log debug message - ends up in /srv/acs/logs on drillpress
+    /// Log debug message - ends up in /srv/acs/logs on drillpress.
+    /// Messages are buffered and sent in batches.
+    /// Use MQTT_LOGx to log subject to the module's log level.
     void log(const std::string& msg);
 
+    /// Send buffered log messages now
+    void flush_log();
+
+    /// Incremented on every (re)connect to the broker
+    uint32_t get_connect_count() const
+    {
+        return connect_count;
+    }
+
     /// Announce status.
     /// Topic is /hal9k/acs/status/<ident> by default
     void set_status(const char* data,
@@ -56,12 +95,68 @@ public:
     /// Announce closed status to Slack via gateway
     void slack_announce_closed();
     
+    struct Outbox_stats
+    {
+        int dropped_debug = 0;
+        int dropped_normal = 0;
+        /// Audit messages that could not be spilled
+        int dropped_audit = 0;
+        int spilled = 0;
+        int replayed = 0;
+        /// Spilled messages not yet replayed
+        int spill_pending = 0;
+        /// Spilled messages lost because the ring was full
+        int spill_overwritten = 0;
+    };
+
+    Outbox_stats get_outbox_stats();
+
+    /// Total size of messages published since boot
+    uint32_t get_bytes_published() const
+    {
+        return bytes_published;
+    }
+
+    /// Incremented whenever the result of get_open_doors() or
+    /// get_present_cards() changes
+    uint32_t get_fleet_version() const
+    {
+        return fleet_version;
+    }
+
     /// Get list of open doors
     std::string get_open_doors();
 
     std::string get_present_cards();
     
-    std::pair<std::string, std::string> get_and_clear_action();
+    struct Action
+    {
+        std::string action;
+        std::string arg;
+        /// Signed stamp of the action message, identifies the action in the ack
+        int64_t stamp = 0;
+        /// esp_timer_get_time() when the action was received
+        int64_t received = 0;
+    };
+
+    /// Get oldest pending action and remove it from the queue.
+    /// Returns false if there is none.
+    bool get_next_action(Action& action);
+
+    /// Publish result of action on hal9k/acs/ack/<ident>, including the
+    /// time from receiving the action until now
+    void ack_action(const Action& action, const char* result);
+
+    /// Set task to be notified by setting bits in its notification value.
+    /// action_bits are set when an action arrives, and status_bits when the
+    /// status of other devices changes, we reconnect, or process() has
+    /// work to do.
+    void set_listener(TaskHandle_t task, uint32_t action_bits, uint32_t status_bits);
+
+    /// Publish the birth message and acks queued by the event handler, and
+    /// replay spilled messages. Must be called from the listener task each
+    /// time it is notified.
+    void process();
 
     bool get_allow_open() const;
 
@@ -75,33 +170,135 @@ private:
                               int32_t event_id,
                               void* event_data);
 
-    void handle_data(const std::string& topic,
-                     const std::string& data);
+    void handle_data(std::string_view topic,
+                     std::string_view data);
 
-    void handle_status(const std::string& topic,
-                       const std::string& data);
-    
-    void handle_action(const std::string& topic,
-                       const std::string& data);
+    /// device is empty for the global status topic
+    void handle_status(std::string_view device,
+                       std::string_view data);
+
+    /// Clears the fleet status of devices that go offline
+    void handle_online(std::string_view device,
+                       std::string_view data);
+
+    /// device is empty for the global action topic
+    void handle_action(std::string_view device,
+                       std::string_view data);
+
+    /// Returns index of device, allocating one if needed. Returns -1 if
+    /// there are too many devices.
+    int get_device_index(std::string_view device);
+
+    void update_fleet_status(std::string_view device,
+                             const Status_fields& fields);
+
+    using Topic_handler = void (Mqtt::*)(std::string_view subtopic,
+                                         std::string_view data);
+
+    struct Route
+    {
+        /// Subscription, must end in "/#"
+        const char* filter;
+        Topic_handler handler;
+    };
+
+    /// Topics we subscribe to. Messages are routed to the handler of the
+    /// matching filter.
+    const Route routes[3] = {
+        { "hal9k/acs/status/#", &Mqtt::handle_status },
+        { "hal9k/acs/online/#", &Mqtt::handle_online },
+        { "hal9k/acs/action/#", &Mqtt::handle_action },
+    };
     
-    static bool sign(cJSON* payload, const std::string& message);
+    static void log_timer_callback(void* arg);
+
+    static constexpr size_t MAX_TOPIC_SIZE = 64;
+
+    enum class Priority
+    {
+        /// Dropped first when the outbox fills up
+        Debug,
+        Normal,
+        /// Spilled to flash while offline, and replayed later
+        Audit,
+    };
+
+    /// Set bits in listener's notification value
+    void notify_listener(uint32_t bits);
+
+    /// Enqueue message, unless the outbox is too full for its priority.
+    /// Returns message ID, or -1 if not enqueued.
+    int publish(const char* topic, const char* data, size_t len,
+                int qos, bool retain, Priority priority);
+
+    /// Enqueue a few spilled messages, if the outbox has room
+    void replay_spilled();
+
+    int get_nof_spilled();
+
+    /// Add stamp, signature, identifier and message to payload
+    bool sign(Json_writer& payload, std::string_view message);
+
+    /// Publish signed message. user_id is included if not negative.
+    bool publish_signed(const char* topic, std::string_view message,
+                        Priority priority, int user_id = -1);
 
     static bool check_signature(const cJSON* root);
 
     bool connected = false;
+    std::atomic<uint32_t> connect_count = 0;
+    /// Set on connect, cleared when process() has published the birth message
+    std::atomic<bool> birth_pending = false;
     esp_mqtt_client_handle_t client = 0;
+    /// Our device identifier
+    std::string identifier;
+    /// Retained "online"/"offline" (Last Will) topic
+    char online_topic[MAX_TOPIC_SIZE];
+    /// Total size of enqueued messages
+    std::atomic<uint32_t> bytes_published = 0;
+    // Protects outbox_stats and spill_ring
+    std::mutex outbox_mutex;
+    Outbox_stats outbox_stats;
+    Spill_ring spill_ring;
+    // Spilled message being replayed. Only used by process().
+    char replay_topic[MAX_TOPIC_SIZE];
+    char replay_data[Spill_ring::MAX_PAYLOAD];
+    // For building signed messages
+    std::mutex payload_mutex;
+    char payload_buffer[1024];
+    // Log messages not yet sent
+    std::mutex log_mutex;
+    Log_buffer log_buffer;
+    char log_batch[Log_buffer::BATCH_SIZE];
+    esp_timer_handle_t log_timer = nullptr;
     std::string last_status;
     std::string last_space_status;
-    // device -> (door open, unlocked)
-    std::map<std::string, std::pair<bool, bool>> door_status;
-    std::mutex door_status_mutex;
-    // device -> card present
-    std::map<std::string, bool> card_present_status;
-    std::mutex card_present_mutex;
+    // Status of other devices
+    static constexpr int MAX_DEVICES = 32;
+    std::mutex fleet_mutex;
+    std::atomic<uint32_t> fleet_version = 0;
+    /// Device name -> bit number in the bitsets below
+    std::map<std::string, int, std::less<>> device_index;
+    uint32_t door_open_bits = 0;
+    uint32_t unlocked_bits = 0;
+    uint32_t card_present_bits = 0;
+    /// Formatted lists, rebuilt when a bitset changes
+    std::string open_doors;
+    std::string present_cards;
     // action
     mutable std::mutex action_mutex;
-    std::string current_action;
-    std::string current_action_arg;
+    /// Actions not yet handled by the controller
+    std::deque<Action> actions;
+    struct Pending_ack
+    {
+        Action action;
+        const char* result = nullptr;
+    };
+    /// Acks for actions not passed to the controller
+    std::deque<Pending_ack> acks;
+    std::atomic<TaskHandle_t> listener = nullptr;
+    uint32_t action_bits = 0;
+    uint32_t status_bits = 0;
     bool allow_open = false;
 };
 
@@ -1,6 +1,7 @@
 #include "nvs.h"
 
 #include "defs.h"
+#include "signer.h"
 
 #include <string.h>
 
@@ -70,6 +71,9 @@ void set_private_key(const uint8_t* key)
     ESP_ERROR_CHECK(nvs_open("storage", NVS_READWRITE, &my_handle));
     ESP_ERROR_CHECK(nvs_set_blob(my_handle, PRIVKEY_KEY, key, SIGNING_KEY_SIZE));
     nvs_close(my_handle);
+    memcpy(private_key, key, SIGNING_KEY_SIZE);
+    // Signer caches the hashed secret
+    Signer::instance().reset();
 }
 
 void set_is_main(bool is_main)
@@ -0,0 +1,271 @@
+#include "permparser.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+Permissions_parser::Permissions_parser(Card_table& t)
+    : table(t)
+{
+}
+
+bool Permissions_parser::is_complete() const
+{
+    return done && !error;
+}
+
+bool Permissions_parser::add(const char* data, size_t len)
+{
+    nof_bytes += len;
+    for (size_t i = 0; i < len && !error; ++i)
+    {
+        const char c = data[i];
+        if (in_string)
+        {
+            if (in_escape)
+                in_escape = false;
+            else if (c == '\\')
+            {
+                in_escape = true;
+                continue;
+            }
+            else if (c == '"')
+            {
+                in_string = false;
+                handle_token(Token::String);
+                continue;
+            }
+            if (buf_len < MAX_TOKEN_SIZE)
+                buf[buf_len++] = c;
+            else
+                truncated = true;
+            continue;
+        }
+        if (in_scalar)
+        {
+            if (isalnum(c) || c == '-' || c == '+' || c == '.')
+            {
+                if (buf_len < MAX_TOKEN_SIZE)
+                    buf[buf_len++] = c;
+                else
+                    truncated = true;
+                continue;
+            }
+            in_scalar = false;
+            handle_token(Token::Scalar);
+        }
+        switch (c)
+        {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        case '"':
+            if (done)
+            {
+                // Trailing garbage
+                error = true;
+                break;
+            }
+            in_string = true;
+            buf_len = 0;
+            truncated = false;
+            break;
+        case '[':
+            handle_token(Token::Begin_array);
+            break;
+        case ']':
+            handle_token(Token::End_array);
+            break;
+        case '{':
+            handle_token(Token::Begin_object);
+            break;
+        case '}':
+            handle_token(Token::End_object);
+            break;
+        case ':':
+            handle_token(Token::Colon);
+            break;
+        case ',':
+            handle_token(Token::Comma);
+            break;
+        default:
+            if ((isalnum(c) || c == '-') && !done)
+            {
+                in_scalar = true;
+                buf[0] = c;
+                buf_len = 1;
+                truncated = false;
+            }
+            else
+                error = true;
+            break;
+        }
+    }
+    return !error;
+}
+
+void Permissions_parser::handle_token(Token token)
+{
+    buf[buf_len] = 0;
+    if (done)
+    {
+        // Trailing garbage
+        error = true;
+        return;
+    }
+    if (skip_depth)
+    {
+        // Skipping a nested value
+        if (token == Token::Begin_array || token == Token::Begin_object)
+            ++skip_depth;
+        else if (token == Token::End_array || token == Token::End_object)
+            --skip_depth;
+        return;
+    }
+    switch (depth)
+    {
+    case 0:
+        // Top level must be an array
+        if (token == Token::Begin_array)
+            depth = 1;
+        else
+            error = true;
+        break;
+
+    case 1:
+        // Inside the array
+        switch (token)
+        {
+        case Token::Begin_object:
+            begin_item();
+            break;
+        case Token::End_array:
+            depth = 0;
+            done = true;
+            break;
+        case Token::Begin_array:
+            // Not an item, skip it
+            ++nof_bad_items;
+            skip_depth = 1;
+            break;
+        case Token::Comma:
+            break;
+        case Token::String:
+        case Token::Scalar:
+            ++nof_bad_items;
+            break;
+        default:
+            error = true;
+            break;
+        }
+        break;
+
+    case 2:
+        // Inside an item
+        if (expect_key)
+        {
+            if (token == Token::String)
+            {
+                key = Key::Other;
+                if (!truncated)
+                {
+                    if (!strcmp(buf, "card_id"))
+                        key = Key::Card_id;
+                    else if (!strcmp(buf, "id"))
+                        key = Key::Id;
+                    else if (!strcmp(buf, "int_id"))
+                        key = Key::Int_id;
+                }
+                expect_key = false;
+            }
+            else if (token == Token::End_object)
+                end_item();
+            else
+                error = true;
+            break;
+        }
+        switch (token)
+        {
+        case Token::Colon:
+            break;
+        case Token::Comma:
+            expect_key = true;
+            break;
+        case Token::End_object:
+            end_item();
+            break;
+        default:
+            handle_value(token);
+            break;
+        }
+        break;
+    }
+}
+
+void Permissions_parser::handle_value(Token token)
+{
+    char* end = nullptr;
+    switch (token)
+    {
+    case Token::Begin_array:
+    case Token::Begin_object:
+        // Nested value, skip it
+        skip_depth = 1;
+        break;
+
+    case Token::String:
+        if (key == Key::Card_id && !truncated && buf_len > 0)
+        {
+            card_id = strtoull(buf, &end, 16);
+            has_card_id = !*end;
+        }
+        break;
+
+    case Token::Scalar:
+        if ((key == Key::Id || key == Key::Int_id) && !truncated)
+        {
+            const long value = strtol(buf, &end, 10);
+            if (*end)
+                // Not an integer
+                break;
+            if (key == Key::Id)
+            {
+                id = value;
+                has_id = true;
+            }
+            else
+            {
+                int_id = value;
+                has_int_id = true;
+            }
+        }
+        break;
+
+    default:
+        error = true;
+        break;
+    }
+}
+
+void Permissions_parser::begin_item()
+{
+    depth = 2;
+    expect_key = true;
+    key = Key::Other;
+    has_card_id = has_id = has_int_id = false;
+}
+
+void Permissions_parser::end_item()
+{
+    depth = 1;
+    if (has_card_id && has_id && has_int_id)
+        table.add(card_id, id, int_id);
+    else
+        ++nof_bad_items;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
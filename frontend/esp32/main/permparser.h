@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cardtable.h>
+
+#include <stddef.h>
+
+/// Incremental parser for the /v2/permissions response:
+///   [ { "card_id": "0123456789", "id": 42, "int_id": 17, ... }, ... ]
+/// Data can be fed in arbitrary pieces as it arrives. Each complete item
+/// is added to the table right away, so memory use does not depend on
+/// the size of the response.
+class Permissions_parser
+{
+public:
+    Permissions_parser(Card_table& table);
+
+    /// Feed more data. Returns false once a syntax error has been seen.
+    bool add(const char* data, size_t len);
+
+    /// True if the whole array has been parsed without errors
+    bool is_complete() const;
+
+    /// Number of items that lacked card_id, id, or int_id
+    int get_nof_bad_items() const
+    {
+        return nof_bad_items;
+    }
+
+    size_t get_nof_bytes() const
+    {
+        return nof_bytes;
+    }
+
+private:
+    enum class Token
+    {
+        Begin_array,
+        End_array,
+        Begin_object,
+        End_object,
+        Colon,
+        Comma,
+        String,
+        Scalar,
+    };
+
+    /// Handle a complete token. The text of String and Scalar tokens is in buf.
+    void handle_token(Token token);
+
+    void handle_value(Token token);
+
+    void begin_item();
+
+    void end_item();
+
+    enum class Key
+    {
+        Other,
+        Card_id,
+        Id,
+        Int_id,
+    };
+
+    // Longest string or scalar we care about
+    static constexpr int MAX_TOKEN_SIZE = 15;
+
+    Card_table& table;
+    size_t nof_bytes = 0;
+    int nof_bad_items = 0;
+    bool error = false;
+    bool done = false;
+
+    // Lexer state
+    bool in_string = false;
+    bool in_escape = false;
+    bool in_scalar = false;
+    char buf[MAX_TOKEN_SIZE+1];
+    int buf_len = 0;
+    bool truncated = false;
+
+    // Parser state
+    int depth = 0;          // 0: before array, 1: in array, 2: in item
+    int skip_depth = 0;     // open arrays/objects in a value being skipped
+    bool expect_key = false;
+    Key key = Key::Other;
+
+    // Current item
+    Card_table::Card_id card_id = 0;
+    int id = 0;
+    int int_id = 0;
+    bool has_card_id = false;
+    bool has_id = false;
+    bool has_int_id = false;
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
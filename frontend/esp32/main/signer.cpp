@@ -0,0 +1,106 @@
+#include "signer.h"
+
+#include "nvs.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+static constexpr const char* TAG = "sign";
+
+Signer& Signer::instance()
+{
+    static Signer the_instance;
+    return the_instance;
+}
+
+bool Signer::init()
+{
+    if (initialized)
+        return true;
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS)
+    {
+        ESP_LOGE(TAG, "PSA crypto init failed: %d", status);
+        return false;
+    }
+    status = psa_hash_setup(&keyed_op, PSA_ALG_SHA_256);
+    if (status == PSA_SUCCESS)
+        status = psa_hash_update(&keyed_op, get_private_key(), SIGNING_KEY_SIZE);
+    if (status != PSA_SUCCESS)
+    {
+        ESP_LOGE(TAG, "Hashing secret failed: %d", status);
+        psa_hash_abort(&keyed_op);
+        return false;
+    }
+    initialized = true;
+    return true;
+}
+
+void Signer::reset()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    if (!initialized)
+        return;
+    psa_hash_abort(&keyed_op);
+    keyed_op = PSA_HASH_OPERATION_INIT;
+    initialized = false;
+}
+
+bool Signer::sign(const void* stamp, size_t stamp_size,
+                  const char* message, size_t message_size,
+                  char (&hex)[HEX_SIZE])
+{
+    psa_hash_operation_t hash_op = PSA_HASH_OPERATION_INIT;
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        if (!init())
+            return false;
+        const auto status = psa_hash_clone(&keyed_op, &hash_op);
+        if (status != PSA_SUCCESS)
+        {
+            ESP_LOGE(TAG, "psa_hash_clone failed: %d", status);
+            return false;
+        }
+    }
+    uint8_t sha[PSA_HASH_LENGTH(PSA_ALG_SHA_256)];
+    size_t sha_len;
+    auto status = psa_hash_update(&hash_op, static_cast<const uint8_t*>(stamp), stamp_size);
+    if (status == PSA_SUCCESS)
+        status = psa_hash_update(&hash_op, reinterpret_cast<const uint8_t*>(message), message_size);
+    if (status == PSA_SUCCESS)
+        status = psa_hash_finish(&hash_op, sha, sizeof(sha), &sha_len);
+    if (status != PSA_SUCCESS)
+    {
+        ESP_LOGE(TAG, "Hashing message failed: %d", status);
+        psa_hash_abort(&hash_op);
+        return false;
+    }
+    static constexpr const char* digits = "0123456789abcdef";
+    for (size_t i = 0; i < sizeof(sha); ++i)
+    {
+        hex[2*i] = digits[sha[i] >> 4];
+        hex[2*i + 1] = digits[sha[i] & 0x0F];
+    }
+    hex[HEX_SIZE - 1] = 0;
+    return true;
+}
+
+bool Signer::verify(const void* stamp, size_t stamp_size,
+                    const char* message, size_t message_size,
+                    const char* hex)
+{
+    char expected[HEX_SIZE];
+    if (!sign(stamp, stamp_size, message, message_size, expected))
+        return false;
+    if (strlen(hex) != HEX_SIZE - 1)
+        return false;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < HEX_SIZE - 1; ++i)
+        diff |= expected[i] ^ hex[i];
+    return diff == 0;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "defs.h"
+
+#include <mutex>
+
+#include "psa/crypto.h"
+
+/// Computes message signatures, which are the hex encoded SHA-256 of
+/// secret + timestamp + message.
+///
+/// The hash state after absorbing the secret is computed once and cloned
+/// for each signature, so each signature only hashes the timestamp and
+/// the message. Call reset() when the secret changes.
+class Signer
+{
+public:
+    /// Size of hex encoded signature, including terminator
+    static constexpr size_t HEX_SIZE = 2*SIGNING_KEY_SIZE + 1;
+
+    static Signer& instance();
+
+    /// Compute signature and store it in hex.
+    bool sign(const void* stamp, size_t stamp_size,
+              const char* message, size_t message_size,
+              char (&hex)[HEX_SIZE]);
+
+    /// Check that hex is the signature of stamp and message.
+    /// Comparison takes the same time regardless of where hex differs.
+    bool verify(const void* stamp, size_t stamp_size,
+                const char* message, size_t message_size,
+                const char* hex);
+
+    /// Drop the hashed secret, so the next signature uses the current
+    /// private key
+    void reset();
+
+private:
+    Signer() = default;
+
+    /// Initialize PSA and hash the secret, if not already done
+    bool init();
+
+    std::mutex mutex;
+    bool initialized = false;
+    /// Hash state after absorbing the secret
+    psa_hash_operation_t keyed_op = PSA_HASH_OPERATION_INIT;
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
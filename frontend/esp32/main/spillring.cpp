@@ -0,0 +1,157 @@
+#include "spillring.h"
+
+#include <cardformat.h>
+
+#include <string.h>
+
+#include "esp_log.h"
+
+static constexpr const char* TAG = "spill";
+
+static constexpr auto PARTITION_SUBTYPE = static_cast<esp_partition_subtype_t>(0x41);
+
+static constexpr size_t RECORDS_PER_SECTOR = SPI_FLASH_SEC_SIZE/Spill_ring::RECORD_SIZE;
+
+static uint32_t record_crc(const Spill_ring::Header& header, const uint8_t* payload)
+{
+    auto crc = card_format::crc32(reinterpret_cast<const uint8_t*>(&header.sequence),
+                                  offsetof(Spill_ring::Header, crc) - offsetof(Spill_ring::Header, sequence));
+    return card_format::crc32(payload, header.topic_len + header.data_len, crc);
+}
+
+bool Spill_ring::open()
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, PARTITION_SUBTYPE, "spill");
+    if (!partition)
+    {
+        ESP_LOGE(TAG, "No spill partition");
+        return false;
+    }
+    // Continue after the newest record
+    bool found = false;
+    uint32_t newest = 0;
+    for (size_t i = 0; i < nof_records(); ++i)
+    {
+        Header header;
+        if (esp_partition_read(partition, i*RECORD_SIZE, &header, sizeof(header)) != ESP_OK ||
+            header.magic != MAGIC)
+            continue;
+        if (!found || static_cast<int32_t>(header.sequence - newest) > 0)
+        {
+            newest = header.sequence;
+            next_index = (i + 1) % nof_records();
+            found = true;
+        }
+        if (header.replayed)
+            ++pending;
+    }
+    next_sequence = found ? newest + 1 : 0;
+    ESP_LOGI(TAG, "%d records to replay", pending);
+    return true;
+}
+
+size_t Spill_ring::nof_records() const
+{
+    return partition ? partition->size/RECORD_SIZE : 0;
+}
+
+bool Spill_ring::add(std::string_view topic, std::string_view data)
+{
+    if (!partition || topic.size() + data.size() > MAX_PAYLOAD)
+        return false;
+    if (next_index % RECORDS_PER_SECTOR == 0)
+    {
+        // Entering a new sector, make room
+        for (size_t i = next_index; i < next_index + RECORDS_PER_SECTOR; ++i)
+        {
+            Header header;
+            if (read_pending(i, header))
+            {
+                --pending;
+                ++overwritten;
+            }
+        }
+        const auto err = esp_partition_erase_range(partition, next_index*RECORD_SIZE, SPI_FLASH_SEC_SIZE);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Erase failed: %s", esp_err_to_name(err));
+            return false;
+        }
+        oldest_index = -1;
+    }
+    Header header;
+    header.magic = MAGIC;
+    header.sequence = next_sequence;
+    header.topic_len = topic.size();
+    header.data_len = data.size();
+    header.replayed = 0xFFFFFFFF;
+    uint8_t* payload = buffer + sizeof(header);
+    memcpy(payload, topic.data(), topic.size());
+    memcpy(payload + topic.size(), data.data(), data.size());
+    header.crc = record_crc(header, payload);
+    memcpy(buffer, &header, sizeof(header));
+    const auto err = esp_partition_write(partition, next_index*RECORD_SIZE, buffer,
+                                         sizeof(header) + topic.size() + data.size());
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    next_index = (next_index + 1) % nof_records();
+    ++next_sequence;
+    ++pending;
+    return true;
+}
+
+bool Spill_ring::read_pending(size_t index, Header& header)
+{
+    return esp_partition_read(partition, index*RECORD_SIZE, &header, sizeof(header)) == ESP_OK &&
+        header.magic == MAGIC && header.replayed;
+}
+
+bool Spill_ring::get_oldest(std::string_view& topic, std::string_view& data)
+{
+    oldest_index = -1;
+    if (!pending)
+        return false;
+    // Records are written in order, so start at the oldest position
+    for (size_t n = 0; n < nof_records(); ++n)
+    {
+        const size_t i = (next_index + n) % nof_records();
+        Header header;
+        if (!read_pending(i, header))
+            continue;
+        if (header.topic_len + header.data_len > MAX_PAYLOAD ||
+            esp_partition_read(partition, i*RECORD_SIZE, buffer, sizeof(header) + header.topic_len + header.data_len) != ESP_OK ||
+            record_crc(header, buffer + sizeof(header)) != header.crc)
+        {
+            // Corrupt, e.g. power loss while writing
+            oldest_index = i;
+            mark_replayed();
+            continue;
+        }
+        const auto payload = reinterpret_cast<const char*>(buffer + sizeof(header));
+        topic = std::string_view(payload, header.topic_len);
+        data = std::string_view(payload + header.topic_len, header.data_len);
+        oldest_index = i;
+        return true;
+    }
+    return false;
+}
+
+void Spill_ring::mark_replayed()
+{
+    if (oldest_index < 0)
+        return;
+    const uint32_t zero = 0;
+    const auto err = esp_partition_write(partition, oldest_index*RECORD_SIZE + offsetof(Header, replayed),
+                                         &zero, sizeof(zero));
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "Mark failed: %s", esp_err_to_name(err));
+    oldest_index = -1;
+    --pending;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
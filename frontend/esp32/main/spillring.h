@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+#include "esp_partition.h"
+
+/// Ring of messages stored in the 'spill' flash partition, used to keep
+/// important MQTT messages while the broker cannot be reached.
+///
+/// The partition is divided into fixed size records. When the ring is
+/// full, the oldest sector is erased. A record is marked as replayed by
+/// clearing a header word, which does not require an erase.
+/// Not thread safe.
+class Spill_ring
+{
+public:
+    /// Size of one record, including header
+    static constexpr size_t RECORD_SIZE = 512;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint16_t topic_len;
+        uint16_t data_len;
+        /// CRC of sequence, lengths, topic and data
+        uint32_t crc;
+        /// All ones until replayed, then zero
+        uint32_t replayed;
+    };
+
+    static constexpr size_t MAX_PAYLOAD = RECORD_SIZE - sizeof(Header);
+
+    /// Find partition and scan for records. Returns false if the
+    /// partition is missing.
+    bool open();
+
+    /// Store message. Returns false if it does not fit or cannot be written.
+    bool add(std::string_view topic, std::string_view data);
+
+    /// Get oldest record not yet replayed. The views are valid until the
+    /// next call. Returns false if there is none.
+    bool get_oldest(std::string_view& topic, std::string_view& data);
+
+    /// Mark record returned by get_oldest() as replayed
+    void mark_replayed();
+
+    /// Number of records not yet replayed
+    int get_nof_pending() const
+    {
+        return pending;
+    }
+
+    /// Number of records erased before they were replayed
+    int get_nof_overwritten() const
+    {
+        return overwritten;
+    }
+
+private:
+    static constexpr uint32_t MAGIC = 0x4C495053; // "SPIL"
+
+    size_t nof_records() const;
+
+    /// Read header of record. Returns false if it is not a valid, unreplayed record.
+    bool read_pending(size_t index, Header& header);
+
+    const esp_partition_t* partition = nullptr;
+    /// Where the next record is written
+    size_t next_index = 0;
+    uint32_t next_sequence = 0;
+    /// Index of record returned by get_oldest(), or -1
+    int oldest_index = -1;
+    int pending = 0;
+    int overwritten = 0;
+    uint8_t buffer[RECORD_SIZE];
+};
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
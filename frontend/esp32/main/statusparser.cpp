@@ -0,0 +1,121 @@
+#include "statusparser.h"
+
+#include <stdint.h>
+
+// Maximum nesting of objects and arrays
+static constexpr int MAX_DEPTH = 32;
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_literal_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+        c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+bool parse_status(std::string_view json, Status_fields& fields)
+{
+    int depth = 0;
+    // Bit n is set if level n+1 is an object
+    uint32_t is_object = 0;
+    // Level of the "data" object, or 0
+    int data_depth = 0;
+    bool expect_key = false;
+    // Last key seen at the current level
+    std::string_view key;
+    size_t i = 0;
+    while (i < json.size())
+    {
+        const char c = json[i];
+        if (is_space(c))
+        {
+            ++i;
+            continue;
+        }
+        switch (c)
+        {
+        case '{':
+        case '[':
+            if (depth >= MAX_DEPTH)
+                return false;
+            if (c == '{' && depth == 1 && key == "data")
+                data_depth = 2;
+            ++depth;
+            if (c == '{')
+                is_object |= 1u << (depth - 1);
+            else
+                is_object &= ~(1u << (depth - 1));
+            expect_key = c == '{';
+            ++i;
+            break;
+
+        case '}':
+        case ']':
+            if (depth == 0)
+                return false;
+            if (depth == data_depth)
+                data_depth = 0;
+            --depth;
+            expect_key = false;
+            ++i;
+            break;
+
+        case ',':
+            expect_key = depth > 0 && (is_object & (1u << (depth - 1)));
+            ++i;
+            break;
+
+        case ':':
+            expect_key = false;
+            ++i;
+            break;
+
+        case '"':
+            {
+                const size_t start = ++i;
+                while (i < json.size() && json[i] != '"')
+                    i += json[i] == '\\' ? 2 : 1;
+                if (i >= json.size())
+                    return false;
+                const auto s = json.substr(start, i - start);
+                ++i;
+                if (expect_key)
+                    key = s;
+                else if (depth == data_depth)
+                {
+                    if (key == "door")
+                        fields.door = s;
+                    else if (key == "lock_status")
+                        fields.lock_status = s;
+                }
+            }
+            break;
+
+        default:
+            {
+                if (!is_literal_char(c))
+                    return false;
+                const size_t start = i;
+                while (i < json.size() && is_literal_char(json[i]))
+                    ++i;
+                const auto s = json.substr(start, i - start);
+                if (depth == data_depth && key == "card_present")
+                {
+                    if (s == "true")
+                        fields.card_present = 1;
+                    else if (s == "false")
+                        fields.card_present = 0;
+                }
+            }
+            break;
+        }
+    }
+    return depth == 0;
+}
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
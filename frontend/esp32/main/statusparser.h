@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string_view>
+
+/// The fields we use from status messages from other devices.
+/// The string views point into the message.
+struct Status_fields
+{
+    std::string_view door;
+    std::string_view lock_status;
+    /// 1 = true, 0 = false, -1 = not present
+    int card_present = -1;
+};
+
+/// Extract fields from the "data" object of a status message in a single
+/// pass, without copying or allocating. String values are returned as
+/// they appear in the message, without unescaping.
+/// Returns false if the message is not valid JSON.
+bool parse_status(std::string_view json, Status_fields& fields);
+
+// Local Variables:
+// compile-command: "cd .. && idf.py build"
+// End:
@@ -1,5 +1,7 @@
 #include "util.h"
 
+#include "hw.h"
+
 #include <stdio.h>
 
 #include "cJSON.h"
@@ -25,17 +27,41 @@ std::string strip_np(const std::string& s)
 
 bool is_it_thursday()
 {
-    time_t current = 0;
-    time(&current);
+    const time_t current = get_wall_time();
     struct tm timeinfo;
     localtime_r(&current, &timeinfo);
     return timeinfo.tm_wday == 4;
 }
 
+bool is_it_thursday(time_t t, time_t& next_change)
+{
+    struct tm timeinfo;
+    localtime_r(&t, &timeinfo);
+    const bool thursday = timeinfo.tm_wday == 4;
+    timeinfo.tm_sec = 0;
+    timeinfo.tm_min = 0;
+    timeinfo.tm_hour = 0;
+    ++timeinfo.tm_mday;
+    // Let mktime() figure out DST
+    timeinfo.tm_isdst = -1;
+    next_change = mktime(&timeinfo);
+    return thursday;
+}
+
+time_t next_utc_time(time_t t, int hour, int minute)
+{
+    struct tm timeinfo;
+    gmtime_r(&t, &timeinfo);
+    const int day_secs = (timeinfo.tm_hour*60 + timeinfo.tm_min)*60 + timeinfo.tm_sec;
+    int until = (hour*60 + minute)*60 - day_secs;
+    if (until <= 0)
+        until += 24*60*60;
+    return t + until;
+}
+
 time_t make_timestamp(char* stamp, bool with_tz)
 {
-    time_t current = 0;
-    time(&current);
+    const time_t current = get_wall_time();
     make_timestamp(current, stamp, with_tz);
     return current;
 }
@@ -39,6 +39,13 @@ std::string strip_np(const std::string& s);
 
 bool is_it_thursday();
 
+/// Returns whether it is Thursday at time t, and sets next_change to the
+/// following local midnight
+bool is_it_thursday(time_t t, time_t& next_change);
+
+/// First time after t where the UTC time is hour:minute
+time_t next_utc_time(time_t t, int hour, int minute);
+
 static constexpr int TIMESTAMP_SIZE = 26;
     
 /// Make a timestamp string. Buffer must be TIMESTAMP_SIZE bytes.
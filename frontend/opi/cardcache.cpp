@@ -1,10 +1,16 @@
 #include "cardcache.h"
 #include "logger.h"
 
+#include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <fmt/core.h>
 
 #include <restclient-cpp/restclient.h>
@@ -14,8 +20,16 @@ constexpr util::duration MAX_CACHE_AGE = std::chrono::minutes(15);
 
 constexpr auto BASE_URL = "https://panopticon.hal9k.dk/api";
 
+// The root filesystem is read-only, but /var/tmp is a tmpfs which
+// survives restarts of the frontend
+constexpr auto SNAPSHOT_PATH = "/var/tmp/acs-cards.bin";
+
+constexpr auto UPDATE_INTERVAL = std::chrono::minutes(1);
+// Until the first update has succeeded
+constexpr auto RETRY_INTERVAL = std::chrono::seconds(10);
+
 Card_cache::Card_cache()
-    : cache_thread([this](){ update_cache(); })
+    : start_time(util::now())
 {
     RestClient::init();
     std::ifstream is("./api-token");
@@ -25,31 +39,134 @@ Card_cache::Card_cache()
         fatal_error("Missing API token");
         exit(1);
     }
+    load_snapshot();
+    cache_thread = std::thread([this](){ update_cache(); });
+    lookup_thread = std::thread([this](){ lookup_thread_body(); });
 }
 
 Card_cache::~Card_cache()
 {
-    stop = true;
+    {
+        std::lock_guard<std::mutex> g(lookup_mutex);
+        stop = true;
+    }
+    lookup_cond.notify_all();
+    if (lookup_thread.joinable())
+        lookup_thread.join();
     if (cache_thread.joinable())
         cache_thread.join();
+    drop_snapshot();
 }
 
 Card_cache::Result Card_cache::has_access(Card_cache::Card_id id)
 {
-    std::lock_guard<std::mutex> g(cache_mutex);
-    const auto it = cache.find(id);
-    if (it != cache.end())
     {
-        if (util::now() - it->second.last_update < MAX_CACHE_AGE)
+        std::lock_guard<std::mutex> g(cache_mutex);
+        Card_table::User_info ui;
+        bool found = false;
+        auto last_update = cache.last_update();
+        if (util::is_valid(last_update) || !snapshot)
+            found = cache.find(id, ui);
+        else
         {
-            Logger::instance().log(fmt::format("{:010X}: cached", id));
-            Logger::instance().log_backend(it->second.user_id, "Granted entry");
-            return Result(Access::Allowed, it->second.user_int_id);
+            // Not updated yet, use snapshot from before restart
+            found = Card_table::find(card_format::entries(snapshot), snapshot_header.count, id, ui);
+            last_update = std::chrono::system_clock::from_time_t(snapshot_header.timestamp);
+        }
+        if (found)
+        {
+            if (util::now() - last_update < MAX_CACHE_AGE)
+            {
+                Logger::instance().log(fmt::format("{:010X}: cached", id));
+                Logger::instance().log_backend(ui.user_id, "Granted entry");
+                if (!first_grant_logged)
+                {
+                    first_grant_logged = true;
+                    Logger::instance().log(fmt::format("First cached grant {} ms after start",
+                                                       std::chrono::duration_cast<std::chrono::milliseconds>(util::now() - start_time).count()));
+                }
+                return Result(Access::Allowed, ui.user_int_id);
+            }
+            Logger::instance().log(fmt::format("{:010X}: stale", id));
+            // Cache entry is outdated
         }
-        Logger::instance().log(fmt::format("{:10X}: stale", id));
-        // Cache entry is outdated
     }
 
+    // Look up in background
+    {
+        std::lock_guard<std::mutex> g(lookup_mutex);
+        if (!lookups_pending.insert(id).second)
+        {
+            Logger::instance().log(fmt::format("{:010X}: lookup already pending", id));
+            return Result(Access::Pending, -1);
+        }
+        lookup_queue.push_back(id);
+    }
+    lookup_cond.notify_one();
+    return Result(Access::Pending, -1);
+}
+
+bool Card_cache::get_completed_lookup(Lookup& lookup)
+{
+    std::lock_guard<std::mutex> g(lookup_mutex);
+    if (completed_lookups.empty())
+        return false;
+    lookup = completed_lookups.front();
+    completed_lookups.pop_front();
+    return true;
+}
+
+void Card_cache::lookup_thread_body()
+{
+    while (1)
+    {
+        Card_id id = 0;
+        {
+            std::unique_lock<std::mutex> lock(lookup_mutex);
+            lookup_cond.wait(lock, [this]() { return stop || !lookup_queue.empty(); });
+            if (stop)
+                return;
+            id = lookup_queue.front();
+            lookup_queue.pop_front();
+        }
+        const auto start = util::now();
+        Result result(Access::Error, -1);
+        try
+        {
+            result = lookup(id);
+        }
+        catch (const std::exception& e)
+        {
+            Logger::instance().log(fmt::format("Exception looking up card: {}", e.what()));
+        }
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(util::now() - start).count();
+        add_latency(ms);
+        {
+            std::lock_guard<std::mutex> g(lookup_mutex);
+            lookups_pending.erase(id);
+            completed_lookups.push_back(Lookup{ id, result });
+        }
+    }
+}
+
+void Card_cache::add_latency(int ms)
+{
+    std::string histogram;
+    {
+        std::lock_guard<std::mutex> g(lookup_mutex);
+        size_t i = 0;
+        while (i < LATENCY_BUCKETS_MS.size() && ms >= LATENCY_BUCKETS_MS[i])
+            ++i;
+        ++latency_counts[i];
+        for (i = 0; i < LATENCY_BUCKETS_MS.size(); ++i)
+            histogram += fmt::format(" <{}:{}", LATENCY_BUCKETS_MS[i], latency_counts[i]);
+        histogram += fmt::format(" >={}:{}", LATENCY_BUCKETS_MS.back(), latency_counts.back());
+    }
+    Logger::instance().log(fmt::format("Lookup took {} ms, histogram (ms){}", ms, histogram));
+}
+
+Card_cache::Result Card_cache::lookup(Card_id id)
+{
     RestClient::Connection conn(BASE_URL);
     conn.SetTimeout(5);
     conn.AppendHeader("Content-Type", "application/json");
@@ -75,13 +192,16 @@ Card_cache::Result Card_cache::has_access(Card_cache::Card_id id)
     {
         const int user_id = resp_body["id"];
         user_int_id = resp_body["int_id"];
-        cache[id] = { user_id, user_int_id, util::now() };
+        {
+            std::lock_guard<std::mutex> g(cache_mutex);
+            cache.insert(id, user_id, user_int_id);
+        }
         Logger::instance().log_backend(user_id, "Granted entry");
     }
     return Result(res ? Access::Allowed : Access::Forbidden, user_int_id);
 }
 
-Card_cache::Card_id get_id_from_string(const std::string& s)
+Card_cache::Card_id Card_cache::get_id_from_string(const std::string& s)
 {
     std::istringstream is(s);
     Card_cache::Card_id id = 0;
@@ -96,56 +216,158 @@ Card_cache::Result Card_cache::has_access(const std::string& sid)
 
 void Card_cache::update_cache()
 {
+    bool updated = false;
     while (!stop)
     {
-        std::this_thread::sleep_for(std::chrono::minutes(1));
         try
         {
-            // Fetch card info
-            RestClient::Connection conn(BASE_URL);
-            conn.SetTimeout(5);
-            conn.AppendHeader("Content-Type", "application/json");
-            conn.AppendHeader("Accept", "application/json");
-            conn.AppendHeader("Authorization", "Token "+api_token);
-            const auto resp = conn.get("/v2/permissions/");
-            Logger::instance().log_verbose(fmt::format("resp.code: {}", resp.code));
-            Logger::instance().log_verbose(fmt::format("resp.body: {}", resp.body));
-            if (resp.code != 200)
-            {
-                Logger::instance().log(fmt::format("Error: Unexpected response from /v2/permissions: {}", resp.code));
-                continue;
-            }
-            const auto resp_body = util::json::parse(resp.body);
-            if (!resp_body.is_array())
+            if (update())
             {
-                Logger::instance().log("Error: Response from /v2/permissions is not an array");
-                continue;
+                if (!updated)
+                    Logger::instance().log(fmt::format("First card cache update {} ms after start",
+                                                       std::chrono::duration_cast<std::chrono::milliseconds>(util::now() - start_time).count()));
+                updated = true;
             }
-            // Create new cache
-            Cache new_cache;
-            for (const auto& elem : resp_body)
-                try
-                {
-                    new_cache[get_id_from_string(elem.at("card_id").get<std::string>())] = {
-                        elem.at("id").get<int>(),
-                        elem.at("int_id").get<int>(),
-                        util::now()
-                    };
-                }
-                catch (const std::exception& e)
-                {
-                    Logger::instance().log(fmt::format("Error: JSON exception {} in {}", e.what(), elem.dump()));
-                }
-            {
-                // Store
-                std::lock_guard<std::mutex> g(cache_mutex);
-                cache.swap(new_cache);
-            }
-            Logger::instance().log("Card cache updated");
         }
         catch (const std::exception& e)
         {
             Logger::instance().log(fmt::format("Exception updating card cache: {}", e.what()));
         }
+        if (updated)
+            std::this_thread::sleep_for(UPDATE_INTERVAL);
+        else
+            std::this_thread::sleep_for(RETRY_INTERVAL);
+    }
+}
+
+bool Card_cache::update()
+{
+    // Fetch card info
+    RestClient::Connection conn(BASE_URL);
+    conn.SetTimeout(5);
+    conn.AppendHeader("Content-Type", "application/json");
+    conn.AppendHeader("Accept", "application/json");
+    conn.AppendHeader("Authorization", "Token "+api_token);
+    if (!etag.empty())
+        // Server replies 304 if nothing has changed
+        conn.AppendHeader("If-None-Match", etag);
+    const auto resp = conn.get("/v2/permissions/");
+    Logger::instance().log_verbose(fmt::format("resp.code: {}", resp.code));
+    Logger::instance().log_verbose(fmt::format("resp.body: {}", resp.body));
+    if (resp.code == 304)
+    {
+        Cache current;
+        {
+            std::lock_guard<std::mutex> g(cache_mutex);
+            cache.set_last_update(util::now());
+            current = cache;
+        }
+        Logger::instance().log_verbose("Card cache unchanged");
+        // Save new timestamp
+        save_snapshot(current);
+        return true;
+    }
+    if (resp.code != 200)
+    {
+        Logger::instance().log(fmt::format("Error: Unexpected response from /v2/permissions: {}", resp.code));
+        return false;
+    }
+    const auto resp_body = util::json::parse(resp.body);
+    if (!resp_body.is_array())
+    {
+        Logger::instance().log("Error: Response from /v2/permissions is not an array");
+        return false;
+    }
+    // Create new cache
+    Cache new_cache;
+    new_cache.reserve(resp_body.size());
+    for (const auto& elem : resp_body)
+        try
+        {
+            new_cache.add(get_id_from_string(elem.at("card_id").get<std::string>()),
+                          elem.at("id").get<int>(),
+                          elem.at("int_id").get<int>());
+        }
+        catch (const std::exception& e)
+        {
+            Logger::instance().log(fmt::format("Error: JSON exception {} in {}", e.what(), elem.dump()));
+        }
+    new_cache.finalize();
+    new_cache.set_last_update(util::now());
+    save_snapshot(new_cache);
+    const auto size = new_cache.size();
+    const auto heap_bytes = new_cache.heap_bytes();
+    {
+        // Store
+        std::lock_guard<std::mutex> g(cache_mutex);
+        std::swap(cache, new_cache);
+    }
+    // Snapshot is no longer needed
+    drop_snapshot();
+    const auto it = resp.headers.find("ETag");
+    etag = it != resp.headers.end() ? it->second : "";
+    Logger::instance().log(fmt::format("Card cache updated: {} cards, {} bytes",
+                                       size, heap_bytes));
+    return true;
+}
+
+void Card_cache::load_snapshot()
+{
+    const int fd = open(SNAPSHOT_PATH, O_RDONLY);
+    if (fd < 0)
+    {
+        Logger::instance().log("No card cache snapshot");
+        return;
+    }
+    struct stat st;
+    void* ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        Logger::instance().log("Error: Cannot map card cache snapshot");
+        return;
+    }
+    const auto data = reinterpret_cast<const uint8_t*>(ptr);
+    if (!card_format::check_slot(data, st.st_size, snapshot_header))
+    {
+        Logger::instance().log("Error: Invalid card cache snapshot");
+        munmap(ptr, st.st_size);
+        return;
+    }
+    snapshot = data;
+    snapshot_size = st.st_size;
+    snapshot_sequence = snapshot_header.sequence;
+    Logger::instance().log(fmt::format("Card cache snapshot: {} cards", snapshot_header.count));
+}
+
+void Card_cache::drop_snapshot()
+{
+    std::lock_guard<std::mutex> g(cache_mutex);
+    if (!snapshot)
+        return;
+    munmap(const_cast<uint8_t*>(snapshot), snapshot_size);
+    snapshot = nullptr;
+}
+
+void Card_cache::save_snapshot(const Cache& table)
+{
+    const auto header = card_format::make_header(table, ++snapshot_sequence,
+                                                 std::chrono::system_clock::to_time_t(table.last_update()));
+    // Write to a new file and rename it, so that the snapshot is always complete
+    const auto temp_path = std::string(SNAPSHOT_PATH) + ".new";
+    {
+        std::ofstream os(temp_path, std::ios::binary | std::ios::trunc);
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(table.data()), table.size()*Card_table::ENTRY_SIZE);
+        os.close();
+        if (!os)
+        {
+            Logger::instance().log(fmt::format("Error: Cannot write {}", temp_path));
+            return;
+        }
     }
+    if (std::rename(temp_path.c_str(), SNAPSHOT_PATH))
+        Logger::instance().log(fmt::format("Error: Cannot rename {}", temp_path));
 }
@@ -3,9 +3,14 @@
 #include "util.h"
 
 #include <RDM6300.h>
+#include <cardformat.h>
+#include <cardtable.h>
 
-#include <map>
+#include <array>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <set>
 #include <thread>
 
 /// Cache for card info. Retrieves card info from panopticon and caches it.
@@ -20,6 +25,8 @@ public:
         Allowed,
         Forbidden,
         Unknown,
+        /// Lookup in progress, see get_completed_lookup()
+        Pending,
     };
 
     struct Result
@@ -28,28 +35,82 @@ public:
         int user_id; // internal ID
     };
     
+    /// Result of a lookup started by has_access()
+    struct Lookup
+    {
+        Card_id id;
+        Result result;
+    };
+
     Card_cache();
 
     ~Card_cache();
 
+    static Card_id get_id_from_string(const std::string& s);
+
+    /// Check card against the cache. If the card is not cached, a lookup
+    /// is started in the background and Pending is returned.
     Result has_access(Card_id id);
 
     Result has_access(const std::string& id);
 
+    /// Get result of a finished lookup. Returns false if there is none.
+    bool get_completed_lookup(Lookup& lookup);
+
 private:
+    using Cache = Card_table;
+
     /// Updates cache in background
     void update_cache();
 
-    struct User_info
-    {
-        int user_id = 0;
-        int user_int_id = 0;
-        util::time_point last_update;
-    };
-    using Cache = std::map<Card_id, User_info>;
+    /// Fetch permissions. Returns true if the cache is up to date.
+    bool update();
+
+    /// Map snapshot saved before restart
+    void load_snapshot();
+
+    /// Unmap snapshot
+    void drop_snapshot();
+
+    /// Save table, so it is available after a restart
+    void save_snapshot(const Cache& table);
+
+    /// Performs lookups queued by has_access()
+    void lookup_thread_body();
+
+    /// Ask panopticon about a single card
+    Result lookup(Card_id id);
+
+    /// Upper bounds of the lookup latency histogram buckets
+    static constexpr std::array<int, 6> LATENCY_BUCKETS_MS = { 100, 250, 500, 1000, 2000, 5000 };
+
+    void add_latency(int ms);
+
     Cache cache;
     std::mutex cache_mutex;
+    /// ETag of the current cache contents (only used by update_cache())
+    std::string etag;
     std::string api_token;
-    std::thread cache_thread;
+    /// Mapped snapshot file. Only used until the first update.
+    const uint8_t* snapshot = nullptr;
+    size_t snapshot_size = 0;
+    card_format::Header snapshot_header;
+    /// Sequence number of last saved snapshot (only used by update_cache())
+    uint32_t snapshot_sequence = 0;
+    util::time_point start_time;
+    bool first_grant_logged = false;
+    std::mutex lookup_mutex;
+    std::condition_variable lookup_cond;
+    /// Cards waiting to be looked up
+    std::deque<Card_id> lookup_queue;
+    /// Cards queued or being looked up
+    std::set<Card_id> lookups_pending;
+    /// Finished lookups not yet fetched by get_completed_lookup()
+    std::deque<Lookup> completed_lookups;
+    /// Number of lookups per latency bucket. The last one counts lookups
+    /// slower than the largest bucket.
+    std::array<int, LATENCY_BUCKETS_MS.size() + 1> latency_counts = {};
     bool stop = false;
+    std::thread cache_thread;
+    std::thread lookup_thread;
 };
@@ -15,14 +15,14 @@
 
 static constexpr auto UNLOCKED_ALERT_INTERVAL = std::chrono::seconds(30);
 
+static constexpr auto TEMP_STATUS_SHOWN_FOR = std::chrono::seconds(10);
+
 // How long to keep the door open after valid card is presented
 static constexpr auto ENTER_TIME = std::chrono::seconds(30);
 
 // How long to wait before locking when door is closed after leaving
 static constexpr auto LEAVE_TIME = std::chrono::seconds(5);
 
-static constexpr auto TEMP_STATUS_SHOWN_FOR = std::chrono::seconds(10);
-
 // Time door is unlocked after pressing Green
 static constexpr auto UNLOCK_PERIOD = std::chrono::minutes(15);
 static constexpr auto UNLOCK_WARN = std::chrono::minutes(5);
@@ -61,11 +61,13 @@ bool Controller::exists()
 
 void Controller::run()
 {
-    std::map<State, std::function<void(Controller*)>> state_map;
-    state_map[State::initial] = &Controller::handle_initial;
-    state_map[State::locked] = &Controller::handle_locked;
-    state_map[State::open] = &Controller::handle_open;
-    state_map[State::timed_unlock] = &Controller::handle_timed_unlock;
+    // Indexed by State
+    static constexpr void (Controller::*state_handlers[door_state::NOF_STATES])() = {
+        &Controller::handle_initial,
+        &Controller::handle_locked,
+        &Controller::handle_open,
+        &Controller::handle_timed_unlock,
+    };
 
     util::time_point last_gateway_update;
     while (1)
@@ -82,6 +84,8 @@ void Controller::run()
         if (!card_id.empty())
             Logger::instance().log(fmt::format("Card {} swiped", card_id));
 
+        check_pending_cards();
+
         bool gateway_update_needed = false;
         if (status != last_lock_status)
         {
@@ -102,14 +106,8 @@ void Controller::run()
         }
 
         // Handle state
-        auto it = state_map.find(state);
-        if (it == state_map.end())
-            fatal_error(fmt::format("Unhandled state {}", static_cast<int>(state)));
-        const auto old_state = state;
-        it->second(this);
-
-        if (state != old_state)
-            Logger::instance().log(fmt::format("STATE: {}", magic_enum::enum_name(state)));
+        (this->*state_handlers[door_state::index(machine.get())])();
+
         if (keys.red || keys.white || keys.green || keys.leave)
             Logger::instance().log(fmt::format("KEYS: R{:d}W{:d}G{:d}L{:d}",
                                                keys.red, keys.white, keys.green, keys.leave));
@@ -122,16 +120,29 @@ void Controller::run()
     }
 }
 
+void Controller::transition(Trigger trigger)
+{
+    const auto from = machine.get();
+    if (!machine.fire(trigger))
+    {
+        Logger::instance().log(fmt::format("No transition from {} on {}",
+                                           door_state::name(from), door_state::name(trigger)));
+        return;
+    }
+    Logger::instance().log(fmt::format("STATE: {} -> {} on {}", door_state::name(from),
+                                       door_state::name(machine.get()), door_state::name(trigger)));
+}
+
 void Controller::handle_initial()
 {
     reader.set_pattern(Card_reader::Pattern::ready);
-    state = State::locked;
+    transition(Trigger::start);
 }
 
 void Controller::handle_locked()
 {
     ensure_lock_state(Lock::State::locked);
-    reader.set_pattern(Card_reader::Pattern::ready);
+    reader.set_pattern(pending_cards.empty() ? Card_reader::Pattern::ready : Card_reader::Pattern::wait);
     status = "Locked";
     slack_status = ":lock: Door is locked";
     display.set_status(status, Display::Color::orange);
@@ -142,7 +153,7 @@ void Controller::handle_locked()
     {
         Logger::instance().log("Green pressed");
         timeout_dur = UNLOCK_PERIOD;
-        state = State::timed_unlock;
+        transition(Trigger::green);
     }
     else if (!card_id.empty())
     {
@@ -150,7 +161,7 @@ void Controller::handle_locked()
     }
     else if (keys.leave)
     {
-        state = State::timed_unlock;
+        transition(Trigger::leave);
         timeout_dur = LEAVE_TIME;
         slack.send_message(":exit: The Leave button has been pressed");
     }
@@ -163,7 +174,7 @@ void Controller::handle_open()
     if (!is_it_thursday())
     {
         Logger::instance().log("It is no longer Thursday");
-        state = State::locked;
+        transition(Trigger::end_of_thursday);
         slack.announce_closed();
         is_space_open = false;
     }
@@ -171,7 +182,7 @@ void Controller::handle_open()
     {
         slack.announce_closed();
         is_space_open = false;
-        state = State::locked;
+        transition(Trigger::red);
     }
     // Allow scanning new cards while open
     if (!card_id.empty())
@@ -184,7 +195,7 @@ void Controller::handle_timed_unlock()
     if (keys.red || (util::is_valid(timeout) && util::now() >= timeout))
     {
         timeout = util::invalid_time_point();
-        state = State::locked;
+        transition(keys.red ? Trigger::red : Trigger::timeout);
     }
     else if (keys.white)
         check_thursday();
@@ -204,12 +215,12 @@ void Controller::handle_timed_unlock()
         else            
             display.set_status("Open", Display::Color::green);
     }
-    if (!util::is_valid(timeout))
-        state = State::locked;
+    if (machine.get() == State::timed_unlock && !util::is_valid(timeout))
+        transition(Trigger::timeout);
 
     if (keys.leave)
     {
-        state = State::timed_unlock;
+        transition(Trigger::leave);
         timeout_dur = LEAVE_TIME;
         slack.send_message(":exit: The Leave button has been pressed");
     }
@@ -228,7 +239,7 @@ void Controller::check_thursday()
         display.show_message("It is not Thursday yet", Display::Color::red);
         return;
     }
-    state = State::open;
+    transition(Trigger::white_on_thursday);
     slack.announce_open();
 }
 
@@ -240,6 +251,35 @@ Buttons::Keys Controller::read_keys(bool log)
 void Controller::check_card(const std::string& card_id, bool change_state)
 {
     const auto result = card_cache.has_access(card_id);
+    if (result.access == Card_cache::Access::Pending)
+    {
+        // Result is handled by check_pending_cards()
+        auto& pending_change_state = pending_cards[Card_cache::get_id_from_string(card_id)];
+        pending_change_state = pending_change_state || change_state;
+        return;
+    }
+    handle_card_result(card_id, result, change_state);
+}
+
+void Controller::check_pending_cards()
+{
+    Card_cache::Lookup lookup;
+    while (card_cache.get_completed_lookup(lookup))
+    {
+        const auto it = pending_cards.find(lookup.id);
+        if (it == pending_cards.end())
+            continue;
+        // Only unlock if nothing else happened in the meantime
+        const bool change_state = it->second && machine.get() == State::locked;
+        pending_cards.erase(it);
+        handle_card_result(fmt::format("{:010X}", lookup.id), lookup.result, change_state);
+    }
+}
+
+void Controller::handle_card_result(const std::string& card_id,
+                                    const Card_cache::Result& result,
+                                    bool change_state)
+{
     switch (result.access)
     {
     case Card_cache::Access::Allowed:
@@ -247,7 +287,7 @@ void Controller::check_card(const std::string& card_id, bool change_state)
         {
             reader.set_pattern(Card_reader::Pattern::enter);
             slack.send_message(":key: Valid card swiped, unlocking");
-            state = State::timed_unlock;
+            transition(Trigger::card);
             timeout_dur = ENTER_TIME;
         }
         else
@@ -267,6 +307,9 @@ void Controller::check_card(const std::string& card_id, bool change_state)
     case Card_cache::Access::Error:
         slack.send_message(":computer_rage: Internal error checking card");
         break;
+
+    case Card_cache::Access::Pending:
+        break;
     }
 
     ForeningLet::instance().update_last_access(result.user_id, util::now());
@@ -298,14 +341,14 @@ void Controller::update_gateway()
         {
             ensure_lock_state(Lock::State::locked);
             slack.send_message(":lock: Door is locked");
-            state = State::locked;
+            transition(Trigger::remote_lock);
         }
     }
     else if (action == "unlock")
     {
         ensure_lock_state(Lock::State::open);
         slack.send_message(":unlock: Door is unlocked");
-        state = State::timed_unlock;
+        transition(Trigger::remote_unlock);
         timeout_dur = GW_UNLOCK_PERIOD;
     }
     else
@@ -6,6 +6,9 @@
 #include "lock.h"
 #include "util.h"
 
+#include <doorstate.h>
+
+#include <map>
 #include <string>
 
 class Card_reader;
@@ -31,12 +34,11 @@ public:
     Buttons::Keys read_keys(bool do_log = true);
     
 private:
-    enum class State {
-        initial,
-        locked,
-        open,
-        timed_unlock,
-    };
+    using State = door_state::State;
+    using Trigger = door_state::Trigger;
+
+    /// Change state as given by door_state::TRANSITIONS, and log it
+    void transition(Trigger trigger);
 
     void handle_initial();
     void handle_locked();
@@ -44,6 +46,11 @@ private:
     void handle_timed_unlock();
 
     void check_card(const std::string& card_id, bool change_state);
+    /// Handle lookups finished by card_cache
+    void check_pending_cards();
+    void handle_card_result(const std::string& card_id,
+                            const Card_cache::Result& result,
+                            bool change_state);
     bool is_it_thursday() const;
     void check_thursday();
     void ensure_lock_state(Lock::State state);
@@ -57,13 +64,15 @@ private:
     Card_cache card_cache;
     Buttons buttons;
     Gateway gateway;
-    State state = State::initial;
+    door_state::Machine machine;
     bool door_is_open = false;
     Buttons::Keys keys;
     bool simulate = false;
     Lock::Status last_lock_status;
     bool is_space_open = false;
     std::string card_id;
+    /// Cards being looked up, and whether to unlock if allowed
+    std::map<Card_cache::Card_id, bool> pending_cards;
     std::string who;
     util::duration timeout_dur = util::invalid_duration();
     util::time_point timeout = util::invalid_time_point();
@@ -17,6 +17,10 @@ bool run_test(const std::string& arg)
 
         Card_cache::Card_id fl15 = 0x13006042CF;
         std::cout << "fl15: " << static_cast<int>(cc.has_access(fl15).access) << std::endl;
+        Card_cache::Lookup lookup;
+        while (!cc.get_completed_lookup(lookup))
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::cout << "fl15: " << static_cast<int>(lookup.result.access) << std::endl;
         std::cout << "fl15: " << static_cast<int>(cc.has_access(fl15).access) << std::endl;
         return true;
     }
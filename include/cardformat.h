@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cardtable.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Stored format of the card table.
+///
+/// A slot holds a Header followed by the packed, sorted Card_table
+/// entries, so a mapped slot can be searched in place. The entries are
+/// written before the header, so a write that is interrupted leaves a
+/// slot without a valid header.
+///
+/// On the ESP32 the flash partition is split into two slots, and a new
+/// table is written to the slot not in use. On the OPi the snapshot file
+/// is a single slot.
+namespace card_format
+{
+
+constexpr uint32_t MAGIC = 0x43534341; // "ACSC"
+constexpr uint16_t VERSION = 1;
+
+struct Header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    /// Incremented for each write, the slot with the highest is newest
+    uint32_t sequence;
+    uint32_t count;
+    /// When the table was fetched (time_t)
+    int64_t timestamp;
+    uint32_t entries_crc;
+    /// CRC of the fields above
+    uint32_t header_crc;
+};
+
+static_assert(sizeof(Header) == 32);
+
+inline uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/// Maximum number of entries that fit in a slot
+inline size_t max_entries(size_t slot_size)
+{
+    return slot_size < sizeof(Header) ? 0 : (slot_size - sizeof(Header))/Card_table::ENTRY_SIZE;
+}
+
+/// Pointer to entries in slot
+inline const uint8_t* entries(const uint8_t* slot)
+{
+    return slot + sizeof(Header);
+}
+
+inline uint32_t header_crc(const Header& header)
+{
+    return crc32(reinterpret_cast<const uint8_t*>(&header), offsetof(Header, header_crc));
+}
+
+/// Make header for the entries in table
+inline Header make_header(const Card_table& table, uint32_t sequence, int64_t timestamp)
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.entry_size = Card_table::ENTRY_SIZE;
+    header.sequence = sequence;
+    header.count = table.size();
+    header.timestamp = timestamp;
+    header.entries_crc = crc32(table.data(), table.size()*Card_table::ENTRY_SIZE);
+    header.header_crc = header_crc(header);
+    return header;
+}
+
+/// Check that slot contains a complete table. If so, return true and
+/// set header.
+inline bool check_slot(const uint8_t* slot, size_t slot_size, Header& header)
+{
+    if (slot_size < sizeof(header))
+        return false;
+    memcpy(&header, slot, sizeof(header));
+    if (header.magic != MAGIC ||
+        header.version != VERSION ||
+        header.entry_size != Card_table::ENTRY_SIZE ||
+        header.header_crc != header_crc(header))
+        return false;
+    if (header.count > max_entries(slot_size))
+        return false;
+    return header.entries_crc == crc32(entries(slot), header.count*Card_table::ENTRY_SIZE);
+}
+
+/// Of two slots, return the index (0 or 1) of the newest valid one, or -1
+/// if neither is valid.
+inline int newest_slot(const uint8_t* slots, size_t slot_size, Header& header)
+{
+    Header headers[2];
+    bool valid[2];
+    for (int i = 0; i < 2; ++i)
+        valid[i] = check_slot(slots + i*slot_size, slot_size, headers[i]);
+    int newest = -1;
+    if (valid[0] && valid[1])
+        // Compare as signed, so that wraparound works
+        newest = static_cast<int32_t>(headers[1].sequence - headers[0].sequence) > 0 ? 1 : 0;
+    else if (valid[0])
+        newest = 0;
+    else if (valid[1])
+        newest = 1;
+    if (newest >= 0)
+        header = headers[newest];
+    return newest;
+}
+
+} // end namespace
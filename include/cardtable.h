@@ -0,0 +1,160 @@
+#pragma once
+
+#include "RDM6300.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/// Compact table mapping card IDs to user IDs.
+/// Entries are kept in a sorted array of packed 13-byte records, so the
+/// whole table is a single heap block.
+class Card_table
+{
+public:
+    using Card_id = RDM6300::Card_id;
+    using time_point = std::chrono::system_clock::time_point;
+
+    /// Size of one packed entry
+    static constexpr size_t ENTRY_SIZE = 13;
+
+    struct User_info
+    {
+        int user_id = 0;
+        int user_int_id = 0;
+    };
+
+    void reserve(size_t n)
+    {
+        entries.reserve(n);
+    }
+
+    /// Append an entry. Call finalize() when done adding entries.
+    void add(Card_id id, int user_id, int user_int_id)
+    {
+        entries.push_back(make_entry(id, user_id, user_int_id));
+    }
+
+    /// Sort entries. For duplicate card IDs the last one added wins.
+    void finalize()
+    {
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const Entry& a, const Entry& b)
+                         {
+                             return key(a) < key(b);
+                         });
+        auto out = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (out != entries.begin() && key(*(out - 1)) == key(*it))
+                *(out - 1) = *it;
+            else
+                *out++ = *it;
+        }
+        entries.erase(out, entries.end());
+        entries.shrink_to_fit();
+    }
+
+    /// Insert or update a single entry, keeping the table sorted.
+    void insert(Card_id id, int user_id, int user_int_id)
+    {
+        const auto entry = make_entry(id, user_id, user_int_id);
+        auto it = std::lower_bound(entries.begin(), entries.end(), id,
+                                   [](const Entry& e, Card_id id)
+                                   {
+                                       return key(e) < id;
+                                   });
+        if (it != entries.end() && key(*it) == id)
+            *it = entry;
+        else
+            entries.insert(it, entry);
+    }
+
+    /// Look up card. Returns false if not found.
+    bool find(Card_id id, User_info& info) const
+    {
+        return find(data(), entries.size(), id, info);
+    }
+
+    /// Look up card in a sorted array of n packed entries, as returned
+    /// by data(). This allows searching a table stored in flash in place.
+    static bool find(const uint8_t* data, size_t n, Card_id id, User_info& info)
+    {
+        if (!n)
+            return false;
+        // Branch-free lower bound: the loop runs log2(n) times regardless of
+        // the data, and the compare compiles to a conditional move.
+        const Entry* base = reinterpret_cast<const Entry*>(data);
+        while (n > 1)
+        {
+            const auto half = n/2;
+            base = (key(base[half - 1]) < id) ? base + half : base;
+            n -= half;
+        }
+        if (key(*base) != id)
+            return false;
+        info.user_id = base->user_id;
+        info.user_int_id = base->user_int_id;
+        return true;
+    }
+
+    /// Packed entries, ENTRY_SIZE bytes each
+    const uint8_t* data() const
+    {
+        return reinterpret_cast<const uint8_t*>(entries.data());
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    /// Heap memory used by the table
+    size_t heap_bytes() const
+    {
+        return entries.capacity()*sizeof(Entry);
+    }
+
+    /// Time when the table contents were fetched
+    time_point last_update() const
+    {
+        return update_time;
+    }
+
+    void set_last_update(time_point t)
+    {
+        update_time = t;
+    }
+
+private:
+#pragma pack(push, 1)
+    struct Entry
+    {
+        // Card IDs are 40 bits. Fields are little-endian.
+        uint32_t id_low;
+        uint8_t id_high;
+        int32_t user_id;
+        int32_t user_int_id;
+    };
+#pragma pack(pop)
+    static_assert(sizeof(Entry) == ENTRY_SIZE);
+
+    static Entry make_entry(Card_id id, int user_id, int user_int_id)
+    {
+        return {
+            static_cast<uint32_t>(id),
+            static_cast<uint8_t>(id >> 32),
+            user_id,
+            user_int_id
+        };
+    }
+
+    static Card_id key(const Entry& e)
+    {
+        return (static_cast<Card_id>(e.id_high) << 32) | e.id_low;
+    }
+
+    std::vector<Entry> entries;
+    time_point update_time;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <iterator>
+#include <stddef.h>
+
+/// State machine of the door controller, shared by the ESP32 and OPi
+/// frontends.
+///
+/// TRANSITIONS is the table form of design/states.plantuml, and the two
+/// must be kept in sync (frontend/esp32/host/test_doorstate.cpp compares
+/// them). State::initial is the [*] pseudo state. The
+/// controllers decide when a trigger fires, and Machine looks up the next
+/// state. Timings are up to each frontend, as they drive different locks.
+namespace door_state
+{
+
+enum class State
+{
+    initial,
+    locked,
+    open,
+    timed_unlock,
+    Count
+};
+
+enum class Trigger
+{
+    start,
+    white_on_thursday,
+    green,
+    card,
+    leave,
+    red,
+    end_of_thursday,
+    timeout,
+    remote_lock,
+    remote_unlock,
+    Count
+};
+
+constexpr size_t NOF_STATES = static_cast<size_t>(State::Count);
+constexpr size_t NOF_TRIGGERS = static_cast<size_t>(Trigger::Count);
+
+constexpr const char* STATE_NAMES[NOF_STATES] = {
+    "initial",
+    "locked",
+    "open",
+    "timed_unlock",
+};
+
+constexpr const char* TRIGGER_NAMES[NOF_TRIGGERS] = {
+    "start",
+    "white_on_thursday",
+    "green",
+    "card",
+    "leave",
+    "red",
+    "end_of_thursday",
+    "timeout",
+    "remote_lock",
+    "remote_unlock",
+};
+
+constexpr size_t index(State state)
+{
+    return static_cast<size_t>(state);
+}
+
+constexpr size_t index(Trigger trigger)
+{
+    return static_cast<size_t>(trigger);
+}
+
+constexpr const char* name(State state)
+{
+    return STATE_NAMES[index(state)];
+}
+
+constexpr const char* name(Trigger trigger)
+{
+    return TRIGGER_NAMES[index(trigger)];
+}
+
+struct Transition
+{
+    State from;
+    Trigger trigger;
+    State to;
+};
+
+constexpr Transition TRANSITIONS[] = {
+    { State::initial,      Trigger::start,             State::locked },
+    { State::locked,       Trigger::white_on_thursday, State::open },
+    { State::timed_unlock, Trigger::white_on_thursday, State::open },
+    { State::locked,       Trigger::green,             State::timed_unlock },
+    { State::locked,       Trigger::card,              State::timed_unlock },
+    { State::locked,       Trigger::leave,             State::timed_unlock },
+    // Restarts the timeout
+    { State::timed_unlock, Trigger::leave,             State::timed_unlock },
+    { State::open,         Trigger::red,               State::locked },
+    { State::open,         Trigger::end_of_thursday,   State::locked },
+    { State::timed_unlock, Trigger::red,               State::locked },
+    { State::timed_unlock, Trigger::timeout,           State::locked },
+    { State::initial,      Trigger::remote_lock,       State::locked },
+    { State::locked,       Trigger::remote_lock,       State::locked },
+    { State::open,         Trigger::remote_lock,       State::locked },
+    { State::timed_unlock, Trigger::remote_lock,       State::locked },
+    { State::initial,      Trigger::remote_unlock,     State::timed_unlock },
+    { State::locked,       Trigger::remote_unlock,     State::timed_unlock },
+    { State::open,         Trigger::remote_unlock,     State::timed_unlock },
+    { State::timed_unlock, Trigger::remote_unlock,     State::timed_unlock },
+};
+
+/// Next state, indexed by current state and trigger.
+/// State::Count means that the trigger is not allowed in that state.
+using Table = std::array<std::array<State, NOF_TRIGGERS>, NOF_STATES>;
+
+constexpr Table make_table()
+{
+    Table table{};
+    for (auto& row : table)
+        for (auto& to : row)
+            to = State::Count;
+    for (const auto& t : TRANSITIONS)
+        table[index(t.from)][index(t.trigger)] = t.to;
+    return table;
+}
+
+constexpr Table TABLE = make_table();
+
+/// True if a state and trigger appear in more than one transition
+constexpr bool has_duplicates()
+{
+    for (size_t i = 0; i < std::size(TRANSITIONS); ++i)
+        for (size_t j = i + 1; j < std::size(TRANSITIONS); ++j)
+            if (TRANSITIONS[i].from == TRANSITIONS[j].from &&
+                TRANSITIONS[i].trigger == TRANSITIONS[j].trigger)
+                return true;
+    return false;
+}
+
+static_assert(!has_duplicates());
+
+/// Next state, or State::Count if the trigger is not allowed
+constexpr State next_state(State from, Trigger trigger)
+{
+    return TABLE[index(from)][index(trigger)];
+}
+
+// Spot checks of design/states.plantuml
+static_assert(next_state(State::initial, Trigger::start) == State::locked);
+static_assert(next_state(State::locked, Trigger::white_on_thursday) == State::open);
+static_assert(next_state(State::timed_unlock, Trigger::white_on_thursday) == State::open);
+static_assert(next_state(State::locked, Trigger::green) == State::timed_unlock);
+static_assert(next_state(State::locked, Trigger::card) == State::timed_unlock);
+static_assert(next_state(State::locked, Trigger::leave) == State::timed_unlock);
+static_assert(next_state(State::open, Trigger::red) == State::locked);
+static_assert(next_state(State::open, Trigger::end_of_thursday) == State::locked);
+static_assert(next_state(State::timed_unlock, Trigger::red) == State::locked);
+static_assert(next_state(State::timed_unlock, Trigger::timeout) == State::locked);
+// A card is only checked for unlocking when locked
+static_assert(next_state(State::open, Trigger::card) == State::Count);
+static_assert(next_state(State::timed_unlock, Trigger::card) == State::Count);
+
+/// Current state of a controller
+class Machine
+{
+public:
+    State get() const
+    {
+        return state;
+    }
+
+    /// Apply trigger. Returns false, and keeps the current state, if
+    /// the trigger is not allowed in the current state.
+    bool fire(Trigger trigger)
+    {
+        const auto to = next_state(state, trigger);
+        if (to == State::Count)
+            return false;
+        state = to;
+        return true;
+    }
+
+private:
+    State state = State::initial;
+};
+
+} // end namespace
@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+"""
+MQTT load generator: simulates a fleet of door frontends and Bigbro devices
+publishing status and log batches, and sends signed actions to a frontend,
+reporting the round trip times from the acks it sends back.
+"""
+
+import argparse
+import collections
+import hashlib
+import json
+import os
+import random
+import statistics
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+DEFAULT_HOST = "localhost"
+DEFAULT_PORT = 1883
+DEFAULT_TARGET = "main"
+# Acknowledged by the frontend without side effects
+DEFAULT_ACTION = "ping"
+REPORT_INTERVAL = 10
+TICK = 0.01
+DEVICE_PREFIX = "loadtest"
+
+
+def sign(key: bytes, stamp: int, text: str) -> str:
+    """Signature as checked by Mqtt::check_signature() on the ESP32:
+    sha256 of key, stamp as a 32-bit size_t, and text."""
+    return hashlib.sha256(key + struct.pack("<I", stamp) + text.encode()).hexdigest()
+
+
+class Device:
+    def __init__(self, name: str, is_bigbro: bool):
+        self.name = name
+        self.is_bigbro = is_bigbro
+        self.door_open = False
+        self.locked = True
+        self.card_present = False
+
+    def change(self):
+        if self.is_bigbro:
+            self.card_present = not self.card_present
+        elif random.random() < 0.5:
+            self.door_open = not self.door_open
+        else:
+            self.locked = not self.locked
+
+    def status(self) -> str:
+        if self.is_bigbro:
+            data = {"card_present": self.card_present}
+        else:
+            data = {
+                "door": "open" if self.door_open else "closed",
+                "space": "closed",
+                "lock_status": "locked" if self.locked else "unlocked",
+                "version": "loadtest",
+            }
+        return json.dumps({"timestamp": time.strftime("%Y-%m-%d %H:%M:%S"), "data": data})
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.sent = collections.Counter()
+        self.results = collections.Counter()
+        # Stamp -> send times of unacknowledged actions
+        self.pending = collections.defaultdict(collections.deque)
+        self.rtt_ms = []
+        self.device_ms = []
+
+    def report(self, interval: float):
+        with self.lock:
+            sent = dict(self.sent)
+            results = dict(self.results)
+            rtt = self.rtt_ms
+            device = self.device_ms
+            unacked = sum(len(q) for q in self.pending.values())
+            self.sent.clear()
+            self.results.clear()
+            self.rtt_ms = []
+            self.device_ms = []
+        rates = " ".join(f"{k} {v/interval:.1f}/s" for k, v in sorted(sent.items()))
+        print(f"sent: {rates or 'nothing'}")
+        print(f"acks: {sum(results.values())} {results} unacked {unacked}")
+        for name, values in (("rtt", rtt), ("device", device)):
+            if values:
+                values.sort()
+                p95 = values[min(len(values) - 1, int(len(values)*0.95))]
+                print(f"  {name} ms: median {statistics.median(values):.0f} p95 {p95:.0f} max {values[-1]:.0f}")
+        sys.stdout.flush()
+
+
+def on_connect(client, userdata, flags, reason_code, properties=None):
+    if reason_code == 0:
+        client.subscribe(f"hal9k/acs/ack/{userdata['target']}")
+    else:
+        print(f"connection failed, reason_code={reason_code}", file=sys.stderr)
+
+
+def on_message(client, userdata, msg):
+    now = time.monotonic()
+    try:
+        ack = json.loads(msg.payload)
+    except ValueError:
+        print(f"bad ack: {msg.payload!r}", file=sys.stderr)
+        return
+    stats = userdata["stats"]
+    with stats.lock:
+        stats.results[ack.get("result", "?")] += 1
+        sent = stats.pending.get(ack.get("stamp"))
+        if sent:
+            stats.rtt_ms.append((now - sent.popleft())*1000)
+        if "latency_ms" in ack:
+            stats.device_ms.append(ack["latency_ms"])
+
+
+def send_action(client, args, key: bytes, stats: Stats):
+    stamp = int(time.time())
+    text = f"{DEVICE_PREFIX} {args.action}"
+    payload = json.dumps({
+        "stamp": stamp,
+        "hash": sign(key, stamp, text),
+        "identifier": DEVICE_PREFIX,
+        "text": text,
+        "action": args.action,
+    })
+    with stats.lock:
+        stats.pending[stamp].append(time.monotonic())
+        stats.sent["action"] += 1
+    client.publish(f"hal9k/acs/action/{args.target}", payload, qos=1)
+
+
+def send_log_batch(client, device: Device, stats: Stats):
+    # Same format as frontend/esp32/main/logbuffer.h
+    lines = [f"{i*10}|{device.name} simulated log line {i}" for i in range(5)]
+    client.publish(f"hal9k/acs/logbatch/{device.name}", "1 0\n" + "\n".join(lines) + "\n", qos=0)
+    with stats.lock:
+        stats.sent["log"] += 1
+
+
+def publish_status(client, device: Device, stats: Stats):
+    client.publish(f"hal9k/acs/status/{device.name}", device.status(), qos=1, retain=True)
+    with stats.lock:
+        stats.sent["status"] += 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulate a fleet of ACS devices on MQTT")
+    parser.add_argument("--host", default=os.environ.get("MQTT_HOST", DEFAULT_HOST))
+    parser.add_argument("--port", type=int, default=int(os.environ.get("MQTT_PORT", DEFAULT_PORT)))
+    parser.add_argument("--tls", action=argparse.BooleanOptionalAction, default=False,
+                        help="Enable TLS (default: false)")
+    parser.add_argument("--doors", type=int, default=10, help="Number of simulated door frontends")
+    parser.add_argument("--bigbros", type=int, default=5, help="Number of simulated Bigbro devices")
+    parser.add_argument("--status-rate", type=float, default=1.0,
+                        help="Status changes per second, across all devices")
+    parser.add_argument("--log-rate", type=float, default=1.0,
+                        help="Log batches per second, across all devices")
+    parser.add_argument("--action-rate", type=float, default=0.0,
+                        help="Actions per second sent to the target")
+    parser.add_argument("--action", default=DEFAULT_ACTION)
+    parser.add_argument("--target", default=DEFAULT_TARGET, help="Identifier of the frontend under test")
+    parser.add_argument("--key", default=os.environ.get("ACS_SIGNING_KEY", ""),
+                        help="Signing key of the target, as hex")
+    parser.add_argument("--duration", type=float, default=0, help="Seconds to run (default: forever)")
+    args = parser.parse_args()
+
+    key = bytes.fromhex(args.key)
+    if args.action_rate > 0 and not key:
+        parser.error("--key is needed for sending actions")
+
+    devices = [Device(f"{DEVICE_PREFIX}-door-{i:02d}", False) for i in range(args.doors)]
+    devices += [Device(f"{DEVICE_PREFIX}-bigbro-{i:02d}", True) for i in range(args.bigbros)]
+    if not devices:
+        parser.error("no devices to simulate")
+    stats = Stats()
+
+    client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    client.user_data_set({"target": args.target, "stats": stats})
+    client.on_connect = on_connect
+    client.on_message = on_message
+    if args.tls:
+        client.tls_set()
+    client.connect(args.host, args.port, keepalive=60)
+    client.loop_start()
+
+    for device in devices:
+        client.publish(f"hal9k/acs/online/{device.name}", "online", qos=1, retain=True)
+        publish_status(client, device, stats)
+
+    # Fractional number of messages due, per kind
+    due = {"status": 0.0, "log": 0.0, "action": 0.0}
+    start = last = last_report = time.monotonic()
+    try:
+        while not args.duration or last - start < args.duration:
+            time.sleep(TICK)
+            now = time.monotonic()
+            elapsed = now - last
+            last = now
+            due["status"] += args.status_rate*elapsed
+            due["log"] += args.log_rate*elapsed
+            due["action"] += args.action_rate*elapsed
+            while due["status"] >= 1:
+                device = random.choice(devices)
+                device.change()
+                publish_status(client, device, stats)
+                due["status"] -= 1
+            while due["log"] >= 1:
+                send_log_batch(client, random.choice(devices), stats)
+                due["log"] -= 1
+            while due["action"] >= 1:
+                send_action(client, args, key, stats)
+                due["action"] -= 1
+            if now - last_report >= REPORT_INTERVAL:
+                stats.report(now - last_report)
+                last_report = now
+    except KeyboardInterrupt:
+        pass
+
+    # Going offline clears the simulated devices from the fleet status of
+    # the frontends. Also remove the retained messages from the broker.
+    for device in devices:
+        client.publish(f"hal9k/acs/online/{device.name}", "offline", qos=1, retain=True)
+        client.publish(f"hal9k/acs/online/{device.name}", "", qos=1, retain=True)
+        client.publish(f"hal9k/acs/status/{device.name}", "", qos=1, retain=True)
+    # Give outstanding acks a chance to arrive
+    time.sleep(2)
+    stats.report(max(time.monotonic() - last_report, TICK))
+    client.loop_stop()
+    client.disconnect()
+
+
+if __name__ == "__main__":
+    main()
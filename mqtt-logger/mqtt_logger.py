@@ -8,6 +8,7 @@ import argparse
 import logging
 import os
 import sys
+import time
 from logging.handlers import TimedRotatingFileHandler
 
 import paho.mqtt.client as mqtt
@@ -18,6 +19,9 @@ LOG_FILE = os.path.join(LOG_DIR, "acs")
 DEFAULT_HOST = "mqtt.hal9k.dk"
 DEFAULT_PORT = 8883
 DEFAULT_TOPIC = "hal9k/acs/log/#"
+# Batches of log lines, see frontend/esp32/main/logbuffer.h
+DEFAULT_BATCH_TOPIC = "hal9k/acs/logbatch/#"
+BATCH_VERSION = "1"
 DEFAULT_BACKUP_COUNT = 3*24  # keep log files for 3 days
 
 
@@ -55,9 +59,11 @@ def build_logger(log_file: str, backup_count: int) -> logging.Logger:
 def on_connect(client, userdata, flags, reason_code, properties=None):
     logger = userdata["logger"]
     topic = userdata["topic"]
+    batch_topic = userdata["batch_topic"]
     if reason_code == 0:
-        logger.info(f"[mqtt_logger] connected to broker, subscribing to {topic!r}")
+        logger.info(f"[mqtt_logger] connected to broker, subscribing to {topic!r} and {batch_topic!r}")
         client.subscribe(topic)
+        client.subscribe(batch_topic)
     else:
         logger.error(f"[mqtt_logger] connection failed, reason_code={reason_code}")
 
@@ -66,14 +72,49 @@ def on_disconnect(client, userdata, flags, reason_code, properties=None):
     userdata["logger"].warning(f"[mqtt_logger] disconnected, reason_code={reason_code}")
 
 
-def on_message(client, userdata, msg):
-    topic = msg.topic
-    stem = userdata["topic"]
+def strip_stem(topic: str, stem: str) -> str:
     if stem.endswith("#"):
         stem = stem[:-1]
     if topic.startswith(stem):
         topic = topic[len(stem):]
-    userdata["logger"].info(f"{topic}|{msg.payload.decode('utf-8', errors='replace')}")
+    return topic
+
+
+def is_batch(topic: str, batch_topic: str) -> bool:
+    return topic.startswith(batch_topic.rstrip("#"))
+
+
+def log_batch(logger: logging.Logger, device: str, payload: str):
+    """Log each line in a batch with the time it was logged on the device."""
+    now = time.time()
+    lines = payload.split("\n")
+    header = lines[0].split(" ")
+    if header[0] != BATCH_VERSION or len(header) != 2:
+        logger.warning(f"{device}|[unsupported log batch {lines[0]!r}]")
+        return
+    if header[1] != "0":
+        logger.warning(f"{device}|[{header[1]} log lines dropped]")
+    for line in lines[1:]:
+        if not line:
+            continue
+        age_ms, _, text = line.partition("|")
+        try:
+            created = now - int(age_ms)/1000
+        except ValueError:
+            created = now
+        record = logger.makeRecord(logger.name, logging.INFO, __file__, 0, f"{device}|{text}", None, None)
+        record.created = created
+        record.msecs = (created - int(created))*1000
+        logger.handle(record)
+
+
+def on_message(client, userdata, msg):
+    payload = msg.payload.decode('utf-8', errors='replace')
+    if is_batch(msg.topic, userdata["batch_topic"]):
+        log_batch(userdata["logger"], strip_stem(msg.topic, userdata["batch_topic"]), payload)
+        return
+    topic = strip_stem(msg.topic, userdata["topic"])
+    userdata["logger"].info(f"{topic}|{payload}")
 
 
 def main():
@@ -81,6 +122,7 @@ def main():
     parser.add_argument("--host", default=os.environ.get("MQTT_HOST", DEFAULT_HOST))
     parser.add_argument("--port", type=int, default=int(os.environ.get("MQTT_PORT", DEFAULT_PORT)))
     parser.add_argument("--topic", default=os.environ.get("MQTT_TOPIC", DEFAULT_TOPIC))
+    parser.add_argument("--batch-topic", default=os.environ.get("MQTT_BATCH_TOPIC", DEFAULT_BATCH_TOPIC))
     parser.add_argument("--log-file", default=os.environ.get("LOG_FILE", LOG_FILE))
     parser.add_argument("--backup-count", type=int, default=DEFAULT_BACKUP_COUNT,
                         help="Number of daily log files to keep (default: 30)")
@@ -93,7 +135,7 @@ def main():
     logger.info(f"[mqtt_logger] starting — broker={args.host}:{args.port} topic={args.topic!r} tls={args.tls}")
 
     client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
-    client.user_data_set({"logger": logger, "topic": args.topic})
+    client.user_data_set({"logger": logger, "topic": args.topic, "batch_topic": args.batch_topic})
     client.on_connect = on_connect
     client.on_disconnect = on_disconnect
     client.on_message = on_message
@@ -42,7 +42,8 @@ bool get_int(const std::string& line, int& index, int& value)
 
 static std::string version()
 {
-    return "ACS ESP32 cardreader v " VERSION "\n";
+    // "+push" tells the frontend that the M command is supported
+    return "ACS ESP32 cardreader v " VERSION " +push\n";
 }
 
 static std::string get_card()
@@ -55,6 +56,17 @@ static std::string get_card()
     return buf;
 }
 
+// M1 enables push mode, M0 disables it
+static bool set_mode(const std::string line)
+{
+    int start = 0;
+    int mode = 0;
+    if (!get_int(line, start, mode) || mode > 1)
+        return false;
+    set_push_mode(mode);
+    return true;
+}
+
 // S1000 100
 static bool play_sound(const std::string line)
 {
@@ -139,6 +151,15 @@ std::string handle_line(const std::string& line)
     case 'C':
         return get_card();
         break;
+    case 'a':
+    case 'A':
+        // Acknowledge of pushed card ID, no reply
+        ack_pushed_cardid();
+        return "";
+    case 'm':
+    case 'M':
+        ok = set_mode(rest);
+        break;
     case 's':
     case 'S':
         ok = play_sound(rest);
@@ -6,7 +6,7 @@
 
 #include <string>
 
-#define VERSION "0.6"
+#define VERSION "0.7"
 
 constexpr auto CONSOLE_UART_PORT = (uart_port_t) 1;
 
@@ -17,3 +17,9 @@ constexpr const int RS485_RXD = 22;
 constexpr const int RS485_RTS = 21;
 
 RDM6300::Card_id get_and_clear_last_cardid();
+
+/// Enable/disable unsolicited card ID frames (push mode)
+void set_push_mode(bool on);
+
+/// Called when the frontend acknowledges a pushed card ID
+void ack_pushed_cardid();
@@ -14,6 +14,7 @@
 #include "led.h"
 #include "rs485.h"
 
+#include <atomic>
 #include <mutex>
 #include <string>
 
@@ -26,12 +27,21 @@
 static const int MAX_TICKS_WITHOUT_REPLY = 1000;
 static const char* NO_REPLY_PATTERN = "50R0SRG"; // Omit leading P
 
+// Resend a pushed card ID if not acknowledged within this time
+static const int PUSH_RETRY_TICKS = 200 / portTICK_PERIOD_MS;
+static const int MAX_PUSH_ATTEMPTS = 5;
+// Do not push the same card again until this long after it was acknowledged
+static const int PUSH_REPEAT_TICKS = 1000 / portTICK_PERIOD_MS;
+
 extern "C" void console_task(void*);
 extern "C" void led_task(void*);
 
 static std::mutex last_cardid_mutex;
 static RDM6300::Card_id last_cardid;
 
+static std::atomic<bool> push_mode = false;
+static std::atomic<bool> push_acked = false;
+
 RDM6300::Card_id get_and_clear_last_cardid()
 {
     std::lock_guard<std::mutex> g(last_cardid_mutex);
@@ -40,6 +50,73 @@ RDM6300::Card_id get_and_clear_last_cardid()
     return id;
 }
 
+static RDM6300::Card_id get_last_cardid()
+{
+    std::lock_guard<std::mutex> g(last_cardid_mutex);
+    return last_cardid;
+}
+
+void set_push_mode(bool on)
+{
+    push_mode = on;
+}
+
+void ack_pushed_cardid()
+{
+    push_acked = true;
+}
+
+// Push frame: N<10 hex digits><2 hex digits XOR checksum of the ID bytes>
+static std::string make_push_frame(RDM6300::Card_id id)
+{
+    int cs = 0;
+    for (int i = 0; i < RDM6300::ID_SIZE; ++i)
+        cs ^= (id >> (8*i)) & 0xFF;
+    char buf[20];
+    sprintf(buf, "N%010llX%02X\n", id, cs);
+    return buf;
+}
+
+// Send card ID to frontend without waiting for a 'C' poll
+static void push_cardid()
+{
+    static RDM6300::Card_id pushed_id = 0;
+    static RDM6300::Card_id acked_id = 0;
+    static TickType_t last_push = 0;
+    static TickType_t last_ack = 0;
+    static int attempts = 0;
+
+    const auto now = xTaskGetTickCount();
+    if (push_acked.exchange(false) && pushed_id)
+    {
+        acked_id = pushed_id;
+        last_ack = now;
+        pushed_id = 0;
+        get_and_clear_last_cardid();
+    }
+    const auto id = get_last_cardid();
+    if (!id)
+        return;
+    if (id == acked_id && now - last_ack < PUSH_REPEAT_TICKS)
+    {
+        // Card is still in the field, and frontend already has it
+        get_and_clear_last_cardid();
+        return;
+    }
+    if (id != pushed_id)
+    {
+        pushed_id = id;
+        attempts = 0;
+    }
+    else if (attempts >= MAX_PUSH_ATTEMPTS || now - last_push < PUSH_RETRY_TICKS)
+        // Frontend will get it through polling
+        return;
+    ++attempts;
+    last_push = now;
+    const auto frame = make_push_frame(id);
+    write_rs485(frame.c_str(), frame.size());
+}
+
 void rfid_task(void*)
 {
     uart_config_t uart_config = {
@@ -144,6 +221,8 @@ void app_main(void)
                 line.clear();
             }
         }
+        if (push_mode)
+            push_cardid();
         vTaskDelay(10/portTICK_PERIOD_MS);
     }
 }